@@ -12,783 +12,3907 @@
  *
  */
 
+#include <string.h>
+
 #include "DWire.h"
 
 /**** MACROs ****/
 
 /**
- * Create the buffers for the specified module number (e.g. M = 0 for EUSCI_B0_BASE)
- */
-#define CREATEBUFFERS(M) \
-	uint8_t EUSCIB ## M ## _txBuffer[TX_BUFFER_SIZE]; \
-	uint8_t EUSCIB ## M ## _txBufferIndex = 0; \
-	uint8_t EUSCIB ## M ## _txBufferSize = 0; \
-	uint8_t EUSCIB ## M ## _rxBuffer[RX_BUFFER_SIZE]; \
-	uint8_t EUSCIB ## M ## _rxBufferIndex = 0; \
-	uint8_t EUSCIB ## M ## _rxBufferSize = 0; 
-
-/**
- * The main (global) interrupt  handler
- * It ain't pretty, but using this as a macro should increase the performance tremendously
- */
-#define IRQHANDLER(M) \
-	{ \
-		uint_fast16_t status; \
-		status = MAP_I2C_getEnabledInterruptStatus(EUSCI_B ## M ##_BASE); \
-		MAP_I2C_clearInterruptFlag(EUSCI_B ## M ##_BASE, status); \
-		\
-		/* Get a reference to the correct instance */ \
-		/* if it is null, ignore the interrupt */ \
-		DWire * instance = DWire_instances[M]; \
-		if ( !instance ) \
-		{ \
-			/* Disable all interrupts if the handler was not registered */ \
-			MAP_I2C_disableInterrupt(EUSCI_B## M ##_BASE, 0xFFFF); \
-			return; \
-		} \
-		\
-		/* Handle a NAK */ \
-		if ( status & EUSCI_B_I2C_NAK_INTERRUPT ) \
-		{ \
-			/* Disable all other interrupts */ \
-			MAP_I2C_disableInterrupt(EUSCI_B## M ##_BASE, \
-					EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_TRANSMIT_INTERRUPT0 \
-							| EUSCI_B_I2C_NAK_INTERRUPT); \
-							\
-			EUSCIB## M ##_txBufferIndex = 0; \
-			EUSCIB## M ##_rxBufferSize = 0; \
-			/* Mark the request as done and failed */ \
-    		instance->_finishRequest(false); \
-		} \
-		\
-		/* Check for clock low interrupt: if it is low for too long, then reset the I2C peripheral */ \
-		if( status & EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT) \
-		{ \
-			ResetCtl_initiateHardReset(); \
-		} \
-		\
-		/* RXIFG */ \
-		/* Triggered when data has been received */ \
-		if ( status & EUSCI_B_I2C_RECEIVE_INTERRUPT0 ) \
-		{ \
-			/* If we're a master, then we're handling the slave response after/during a request */ \
-			if ( instance->isMaster( ) ) \
-			{ \
-			/* do range checking around this block to avoid possible errors */ \
-				EUSCIB## M ##_rxBuffer[EUSCIB## M ##_rxBufferIndex] = \
-				MAP_I2C_masterReceiveMultiByteNext(EUSCI_B## M ##_BASE); \
-				EUSCIB## M ##_rxBufferIndex++; \
-				\
-				/* if we only need to read 1 more byte, start sending a stop */ \
-				if ( EUSCIB## M ##_rxBufferIndex == EUSCIB## M ##_rxBufferSize - 1 ) \
-				{ \
-					MAP_I2C_masterReceiveMultiByteStop(EUSCI_B## M ##_BASE); \
-				} \
-				\
-				if ( EUSCIB## M ##_rxBufferIndex == EUSCIB## M ##_rxBufferSize ) \
-				{ \
-					/* Disable the RX interrupt */ \
-					MAP_I2C_disableInterrupt(EUSCI_B## M ##_BASE, \
-					EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT); \
-					/* Mark the request as done and succesful */ \
-					instance->_finishRequest(true); \
-				} \
-				/* If we're a slave, then we're receiving data from the master */ \
-			} else \
-			{ \
-				EUSCIB## M ##_rxBuffer[EUSCIB## M ##_rxBufferIndex] = MAP_I2C_slaveGetData( \
-						EUSCI_B## M ##_BASE); \
-				EUSCIB## M ##_rxBufferIndex++; \
-			} \
-		} \
-		\
-		/* As master: triggered when a byte has been transmitted */ \
-		if ( status & EUSCI_B_I2C_TRANSMIT_INTERRUPT0 ) \
-		{ \
-			/* If the module is setup as a master, then we're transmitting data */ \
-			if ( instance->isMaster( ) ) \
-			{ \
-				if ( EUSCIB## M ##_txBufferIndex == 1 ) \
-				{ \
-					/* Send a STOP condition if required */ \
-					if ( instance->_isSendStop( ) ) \
-					{ \
-						MAP_I2C_masterSendMultiByteStop(EUSCI_B## M ##_BASE); \
-					} \
-					/* Disable the TX interrupt */ \
-					MAP_I2C_disableInterrupt(EUSCI_B## M ##_BASE, \
-					EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT); \
-					EUSCIB## M ##_txBufferIndex--; \
-					\
-				} else if ( EUSCIB## M ##_txBufferIndex > 1 ) \
-				{ \
-					/* If we still have data left in the buffer, then transmit that */ \
-					MAP_I2C_masterSendMultiByteNext(EUSCI_B## M ##_BASE, \
-							EUSCIB## M ##_txBuffer[(EUSCIB## M ##_txBufferSize) \
-									- (EUSCIB## M ##_txBufferIndex) + 1]); \
-					EUSCIB## M ##_txBufferIndex--; \
-				} \
-				/* If we're a slave, then we're handling a request from the master */ \
-			} else \
-			{ \
-				instance->_handleRequestSlave( ); \
-			} \
-		} \
-		\
-		/* STPIFG: Called when a STOP is received */ \
-		if ( status & EUSCI_B_I2C_STOP_INTERRUPT ) \
-		{ \
-			if ( EUSCIB## M ##_txBufferIndex != 0 && !instance->isMaster( ) ) \
-			{ \
-				EUSCIB## M ##_rxBufferIndex = 0; \
-				EUSCIB## M ##_rxBufferSize = 0; \
-			} else if ( EUSCIB## M ##_rxBufferIndex != 0 ) \
-			{ \
-				instance->_handleReceive(EUSCIB## M ##_rxBuffer); \
-			} \
-		} \
-	} 
+ * The channel number of a DMA channel mapping (e.g. DMA_CH2_EUSCIB1TX0)
+ */
+#define DMACHANNEL(MAPPING) ((MAPPING) & 0x0F)
+
+/**
+ * The Timer32 module and interrupt of the timeouts
+ */
+#if DWIRE_TIMER32 == 0
+#define DWIRE_TIMER TIMER32_0_BASE
+#define DWIRE_TIMER_INTERRUPT TIMER32_0_INTERRUPT
+#else
+#define DWIRE_TIMER TIMER32_1_BASE
+#define DWIRE_TIMER_INTERRUPT TIMER32_1_INTERRUPT
+#endif
 
 /**** GLOBAL VARIABLES ****/
 
+/**
+ * The buffers of a module (e.g. DWire_buffers[0] for EUSCI_B0_BASE).
+ * As master, the ISR moves the data through txData and rxData, which
+ * point into the caller's buffers for queued transactions
+ */
+struct DWireBuffers
+{
+    uint8_t txBuffer[TX_BUFFER_SIZE];
+    uint8_t txBufferIndex;
+    uint8_t txBufferSize;
+    uint8_t rxBuffer[RX_BUFFER_SIZE];
+    uint8_t rxBufferIndex;
+    uint8_t rxBufferSize;
+    // as a master, bytes read after rxBufferSize and dropped (see
+    // _prepareRequest)
+    uint8_t rxDrop;
+    // as a slave, a frame written by the master is being stored in rxBuffer
+    bool rxFrame;
+    uint8_t * txData;
+    uint8_t * rxData;
+};
+
 /* A reference list of DWire DWire_instances */
 DWire * DWire_instances[4];
 
 // The buffers need to be declared globally, as the interrupts are too
-CREATEBUFFERS( 0 );
-CREATEBUFFERS( 1 );
-CREATEBUFFERS( 2 );
-CREATEBUFFERS( 3 );
+DWireBuffers DWire_buffers[4];
 
-/**** ISR/IRQ Handles ****/
-void EUSCIB0_IRQHandler_I2C( void )
+/**
+ * The register bank of a module as a slave (see DWire::registerBank).
+ * pointer is the register of the next byte; reading is set once a byte
+ * has been loaded for the master in the current frame
+ */
+struct DWireBank
+{
+    uint8_t * registers;
+    const uint8_t * writable;
+    uint16_t size;
+    uint16_t pointer;
+    bool addressed;
+    bool reading;
+    uint8_t first;
+    uint8_t written;
+    void (*onWrite)( uint8_t, uint8_t );
+};
+
+// per module and own address
+DWireBank DWire_banks[4][OWN_ADDRESSES];
+
+/* The own address (its index) of the current or last frame of each module
+ * as a slave, and the interrupt flags of each own address */
+uint8_t DWire_matched[4];
+
+static const uint_fast16_t DWire_addressFlags[OWN_ADDRESSES] = {
+        EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_TRANSMIT_INTERRUPT0,
+        EUSCI_B_I2C_RECEIVE_INTERRUPT1 | EUSCI_B_I2C_TRANSMIT_INTERRUPT1,
+        EUSCI_B_I2C_RECEIVE_INTERRUPT2 | EUSCI_B_I2C_TRANSMIT_INTERRUPT2,
+        EUSCI_B_I2C_RECEIVE_INTERRUPT3 | EUSCI_B_I2C_TRANSMIT_INTERRUPT3 };
+
+/**
+ * The staged responses of a module as a slave (see DWire::publishResponse).
+ * published and sending hold the buffer number + 1, 0 for none; the main
+ * loop only fills the buffer that is neither of them
+ */
+struct DWireResponse
 {
-    IRQHANDLER(0);
+    uint8_t data[2][RESPONSE_SIZE];
+    uint8_t length[2];
+    volatile uint8_t published;
+    volatile uint8_t sending;
+    uint8_t index;
+};
+
+DWireResponse DWire_responses[4];
+
+/**
+ * The ring of frames received by a module as a slave (see
+ * DWire::receiveFrames), each stored as its length followed by its bytes.
+ * The ISR fills a frame in from head on and publishes it on its STOP or
+ * repeated START by moving head to fill; readFrame only moves tail on.
+ * The indices run freely and are masked on access
+ */
+struct DWireFrames
+{
+    volatile uint8_t * ring;
+    uint16_t mask;
+    volatile uint16_t head;
+    volatile uint16_t tail;
+    uint16_t fill;
+    // the frame in progress did not fit
+    bool dropping;
+    volatile uint32_t lost;
+};
+
+DWireFrames DWire_frames[4];
+
+#if DWIRE_STATISTICS
+/* The counters of each module (see DWire::statistics); waitTime is kept
+ * in Timer32 ticks, which would wrap within half an hour in 32 bits */
+DWireStatistics DWire_statistics[4];
+
+#define DWIRE_COUNT( m, counter, n ) (DWire_statistics[m].counter += (n))
+#else
+#define DWIRE_COUNT( m, counter, n ) ((void) 0)
+#endif
+
+#if DWIRE_TRACE
+/**
+ * The trace ring of a module (see DWire::readTrace). The interrupt handler
+ * of the module writes the events and head, readTrace only moves tail on;
+ * an event that does not fit is dropped and counted in lost. The times are
+ * DWT cycle counts, which readTrace keeps on counting in cycles
+ */
+struct DWireTrace
+{
+    volatile DWireTraceEvent events[TRACE_SIZE];
+    volatile uint16_t head;
+    volatile uint16_t tail;
+    volatile uint32_t lost;
+    uint32_t last;
+    uint64_t cycles;
+};
+
+DWireTrace DWire_traces[4];
+
+#define DWIRE_TRACE_EVENT( m, type, data ) DWire_trace( m, type, data, DWire_cycles( ) )
+#else
+#define DWIRE_TRACE_EVENT( m, type, data ) ((void) 0)
+#endif
+
+#if DWIRE_LATENCY
+/* The latency histograms of each module, a slot is free while it has no
+ * transactions */
+DWireLatency DWire_latency[4][LATENCY_DEVICES];
+#endif
+
+#if DWIRE_DMA_TABLE
+/* uDMA control table, used if the application has not set up one itself.
+ * Only enableDMA refers to it, so without DMA the linker can leave it out */
+uint8_t DWire_dmaControlTable[256] __attribute__((aligned(1024)));
+#endif
+
+/* The deadlines of all modules share a free-running Timer32, which is
+ * reloaded to reach zero at the earliest one, or after 2^31 ticks with no
+ * deadline. It never stops once started, and wraps around after zero, so
+ * that it is also the clock of the statistics. Times are
+ * counted in its ticks (MCLK / 16) and compared as signed differences */
+bool DWire_timerReady;
+volatile bool DWire_timerRunning;
+volatile uint32_t DWire_timerEnd;   // when it reaches zero
+
+/**** REGISTER ACCESS ****/
+
+/*
+ * The eUSCI_B calls made by the interrupt handlers and while starting a
+ * transfer. With DWIRE_DIRECT_REGISTERS they are inlined as accesses to
+ * the registers of the module, which are at a constant address in the
+ * interrupt handlers. Otherwise they are the driverlib (ROM) functions.
+ */
+#if DWIRE_DIRECT_REGISTERS
+
+static inline uint_fast16_t DWire_getEnabledInterruptStatus( uint32_t base )
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( base );
+    return regs->IFG & regs->IE;
 }
 
-void EUSCIB1_IRQHandler_I2C( void )
+static inline uint_fast16_t DWire_getInterruptStatus( uint32_t base, uint16_t mask )
 {
-    IRQHANDLER(1);
+    return EUSCI_B_CMSIS( base )->IFG & mask;
 }
 
-void EUSCIB2_IRQHandler_I2C( void )
+static inline void DWire_clearInterruptFlag( uint32_t base, uint_fast16_t mask )
 {
-    IRQHANDLER(2);
+    EUSCI_B_CMSIS( base )->IFG &= (uint16_t) ~mask;
 }
 
-void EUSCIB3_IRQHandler_I2C( void )
+static inline void DWire_enableInterrupt( uint32_t base, uint_fast16_t mask )
 {
-    IRQHANDLER(3);
+    EUSCI_B_CMSIS( base )->IE |= (uint16_t) mask;
 }
 
-/**** CONSTRUCTORS ****/
-DWire::DWire( uint8_t mod ) 
+static inline void DWire_disableInterrupt( uint32_t base, uint_fast16_t mask )
 {
-	switch (mod) 
-    {
-        case 0:
-        	this->module = EUSCI_B0_BASE;
-            break;
+    EUSCI_B_CMSIS( base )->IE &= (uint16_t) ~mask;
+}
 
-        case 2:
-            this->module = EUSCI_B2_BASE;
-            break;
-            
-        case 3:
-            this->module = EUSCI_B3_BASE;
-            break;
-            
-        case 1:
-        default:
-            this->module = EUSCI_B1_BASE;
-            break;
-    }
-    this->mode = FAST;
+static inline void DWire_setMode( uint32_t base, uint_fast8_t mode )
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( base );
+    regs->CTLW0 = (regs->CTLW0 & (uint16_t) ~EUSCI_B_CTLW0_TR) | mode;
 }
 
-DWire::DWire( ) 
+static inline void DWire_setSlaveAddress( uint32_t base, uint_fast16_t slaveAddress )
 {
-	// set default settings
-    this->module = EUSCI_B1_BASE;
-    this->mode = FAST;
+    EUSCI_B_CMSIS( base )->I2CSA = (uint16_t) slaveAddress;
 }
 
-DWire::~DWire( ) 
+static inline uint8_t DWire_isBusBusy( uint32_t base )
 {
-	/* Reset the module */
-    MAP_I2C_disableModule( module );
-    
-    /* Deregister from the moduleMap */
-    switch (module) 
+    return EUSCI_B_CMSIS( base )->STATW & EUSCI_B_STATW_BBUSY;
+}
+
+static inline uint8_t DWire_masterIsStopSent( uint32_t base )
+{
+    return EUSCI_B_CMSIS( base )->CTLW0 & EUSCI_B_CTLW0_TXSTP;
+}
+
+static inline bool DWire_masterIsStartSent( uint32_t base )
+{
+    return EUSCI_B_CMSIS( base )->CTLW0 & EUSCI_B_CTLW0_TXSTT;
+}
+
+static inline void DWire_masterSendStart( uint32_t base )
+{
+    EUSCI_B_CMSIS( base )->CTLW0 |= EUSCI_B_CTLW0_TXSTT;
+}
+
+static inline void DWire_masterReceiveStart( uint32_t base )
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( base );
+    regs->CTLW0 = (regs->CTLW0 & (uint16_t) ~EUSCI_B_CTLW0_TR) | EUSCI_B_CTLW0_TXSTT;
+}
+
+/**
+ * Send the START and load the first byte once it has been generated,
+ * with the TX interrupt held off until then
+ */
+static inline bool DWire_masterSendMultiByteStartWithTimeout( uint32_t base, uint8_t data,
+        uint32_t timeout )
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( base );
+    uint16_t txie = regs->IE & EUSCI_B_IFG_TXIFG0;
+
+    regs->IE &= (uint16_t) ~EUSCI_B_IFG_TXIFG0;
+    regs->CTLW0 |= EUSCI_B_CTLW0_TR | EUSCI_B_CTLW0_TXSTT;
+
+    while (!(regs->IFG & EUSCI_B_IFG_TXIFG0))
     {
-        case EUSCI_B0_BASE:
-            DWire_instances[0] = 0;
-            break;
-            
-        case EUSCI_B1_BASE:
-            DWire_instances[1] = 0;
-            break;
-            
-        case EUSCI_B2_BASE:
-            DWire_instances[2] = 0;
-            
-            break;
-        case EUSCI_B3_BASE:
-            DWire_instances[3] = 0;
-            break;
+        if (!--timeout)
+            return false;
     }
+
+    regs->TXBUF = data;
+    regs->IE |= txie;
+    return true;
 }
 
-/**** PUBLIC METHODS ****/
+/* Only used with the TX interrupt enabled: TXIFG is set */
+static inline void DWire_masterSendMultiByteNext( uint32_t base, uint8_t data )
+{
+    EUSCI_B_CMSIS( base )->TXBUF = data;
+}
 
-void DWire::begin( ) 
+static inline void DWire_masterSendMultiByteStop( uint32_t base )
 {
-    // Initialising the given module as a master
-    busRole = BUS_ROLE_MASTER;
-    slaveAddress = 0;
-    _initMain( );
+    EUSCI_B_CMSIS( base )->CTLW0 |= EUSCI_B_CTLW0_TXSTP;
+}
 
-    // calculate the number of iterations of a loop to generate
-    // a delay based on clock speed
-    // this is needed to handle NACKs in a way that is independent
-    // of CPU speed and OS (Energia or not)
-	delayCycles = MAP_CS_getMCLK( ) * 12 / 7905857;
-	
-	/* Set the EUSCI configuration */
-	config.selectClockSource = EUSCI_B_I2C_CLOCKSOURCE_SMCLK;	// SMCLK Clock Source
-	config.i2cClk = MAP_CS_getSMCLK( );							// Get the SMCLK clock frequency
-	config.byteCounterThreshold = 0;							// No byte counter threshold
-	config.autoSTOPGeneration = EUSCI_B_I2C_NO_AUTO_STOP;		// No Autostop
-	
-    if (mode == FAST) 
-    {
-    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_400KBPS;
-    	
-        _initMaster( &config );
-		// accommodate a delay of at least ~30us (~68us measured)
-        delayCycles = delayCycles * 4;
-    } 
-    else if(mode == FASTPLUS) 
+static inline uint8_t DWire_masterReceiveMultiByteNext( uint32_t base )
+{
+    return (uint8_t) EUSCI_B_CMSIS( base )->RXBUF;
+}
+
+static inline void DWire_masterReceiveMultiByteStop( uint32_t base )
+{
+    EUSCI_B_CMSIS( base )->CTLW0 |= EUSCI_B_CTLW0_TXSTP;
+}
+
+static inline void DWire_slavePutData( uint32_t base, uint8_t data )
+{
+    EUSCI_B_CMSIS( base )->TXBUF = data;
+}
+
+static inline uint8_t DWire_slaveGetData( uint32_t base )
+{
+    return (uint8_t) EUSCI_B_CMSIS( base )->RXBUF;
+}
+
+#else
+
+#define DWire_getEnabledInterruptStatus MAP_I2C_getEnabledInterruptStatus
+#define DWire_getInterruptStatus MAP_I2C_getInterruptStatus
+#define DWire_clearInterruptFlag MAP_I2C_clearInterruptFlag
+#define DWire_enableInterrupt MAP_I2C_enableInterrupt
+#define DWire_disableInterrupt MAP_I2C_disableInterrupt
+#define DWire_setMode MAP_I2C_setMode
+#define DWire_setSlaveAddress MAP_I2C_setSlaveAddress
+#define DWire_isBusBusy MAP_I2C_isBusBusy
+#define DWire_masterIsStopSent MAP_I2C_masterIsStopSent
+#define DWire_masterIsStartSent MAP_I2C_masterIsStartSent
+#define DWire_masterSendStart MAP_I2C_masterSendStart
+#define DWire_masterReceiveStart MAP_I2C_masterReceiveStart
+#define DWire_masterSendMultiByteStartWithTimeout MAP_I2C_masterSendMultiByteStartWithTimeout
+#define DWire_masterSendMultiByteNext MAP_I2C_masterSendMultiByteNext
+#define DWire_masterSendMultiByteStop MAP_I2C_masterSendMultiByteStop
+#define DWire_masterReceiveMultiByteNext MAP_I2C_masterReceiveMultiByteNext
+#define DWire_masterReceiveMultiByteStop MAP_I2C_masterReceiveMultiByteStop
+#define DWire_slavePutData MAP_I2C_slavePutData
+#define DWire_slaveGetData MAP_I2C_slaveGetData
+
+#endif
+
+/**** TIMEOUTS ****/
+
+/**
+ * The time in ticks. Past zero the counter wraps around to 0xFFFFFFFF and
+ * goes on, so end - value keeps counting until the timer is reloaded
+ */
+static uint32_t DWire_now( void )
+{
+    uint32_t end;
+    uint32_t value;
+
+    // read again if the timer interrupt has reloaded the timer meanwhile
+    do
     {
-    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_1MBPS;
-    	
-        _initMaster( &config );
-        // accommodate a delay of ~12us (~16us measured)
-    } 
-    else 
+        end = DWire_timerEnd;
+        value = DWire_timerRunning ? MAP_Timer32_getValue( DWIRE_TIMER ) : 0;
+    } while (end != DWire_timerEnd);
+
+    return end - value;
+}
+
+/**
+ * Let the timer reach zero after the given number of ticks from now;
+ * called with interrupts disabled. The time is read again right before
+ * the reload, so that only the ticks of the reload itself are lost
+ */
+static void DWire_runTimer( uint32_t ticks )
+{
+    uint32_t now = DWire_now( );
+    DWire_timerEnd = now + ticks;
+    MAP_Timer32_setCount( DWIRE_TIMER, ticks );
+    if (!DWire_timerRunning)
     {
-    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_100KBPS;
-    	
-        _initMaster( &config );
-        // accommodate a delay of at least ~120us (~130 us measured)
-        delayCycles = delayCycles * 10;
+        DWire_timerRunning = true;
+        MAP_Timer32_startTimer( DWIRE_TIMER, false );
     }
 }
 
-void DWire::setStandardMode( ) 
+/**
+ * The time in ticks, starting the timer on the first call
+ */
+static uint32_t DWire_time( void )
 {
-    this->mode = STANDARD;
+    if (!DWire_timerReady)
+        return 0;
+
+    if (!DWire_timerRunning)
+    {
+        bool disabled = MAP_Interrupt_disableMaster( );
+        if (!DWire_timerRunning)
+        {
+            DWire_runTimer( 0x7FFFFFFF );
+        }
+
+        if (!disabled)
+        {
+            MAP_Interrupt_enableMaster( );
+        }
+    }
+    return DWire_now( );
 }
 
-void DWire::setFastMode( ) 
+/**** REGISTER BANK ****/
+
+/**
+ * A byte written by the master: the first one of a frame sets the
+ * pointer, the next ones go to the writable bits of the registers
+ */
+static inline void DWire_bankWrite( DWireBank & bank, uint8_t data )
 {
-    this->mode = FAST;
+    if (!bank.addressed)
+    {
+        bank.pointer = data < bank.size ? data : data % bank.size;
+        bank.first = bank.pointer;
+        bank.addressed = true;
+        return;
+    }
+
+    uint8_t mask = bank.writable ? bank.writable[bank.pointer] : 0xFF;
+    uint8_t & target = bank.registers[bank.pointer];
+    target = (target & ~mask) | (data & mask);
+    bank.written++;
+    bank.pointer = bank.pointer + 1 < bank.size ? bank.pointer + 1 : 0;
 }
 
-void DWire::setFastModePlus( ) 
+/**
+ * The next byte for the master
+ */
+static inline uint8_t DWire_bankRead( DWireBank & bank )
 {
-    this->mode = FASTPLUS;
+    uint8_t data = bank.registers[bank.pointer];
+    bank.pointer = bank.pointer + 1 < bank.size ? bank.pointer + 1 : 0;
+    bank.reading = true;
+    return data;
 }
 
-void DWire::begin( uint8_t address ) 
+/**
+ * The next byte of the staged response; the first one of a read picks
+ * the response published at that moment
+ */
+static inline uint8_t DWire_responseByte( DWireResponse & response )
 {
-    // Initialising the given module as a slave
-    busRole = BUS_ROLE_SLAVE;
-    slaveAddress = address;
-
-    _initMain( );
+    if (!response.sending)
+    {
+        response.sending = response.published;
+        response.index = 0;
+    }
 
-    _initSlave( );
+    uint8_t n = response.sending - 1;
+    return response.index < response.length[n] ? response.data[n][response.index++] : 0xFF;
 }
 
 /**
- * Begin a transmission as a master
+ * Called on the START or STOP that ends a frame
  */
-void DWire::beginTransmission( uint_fast8_t slaveAddress ) 
+static void DWire_bankEnd( DWireBank & bank )
 {
-    // Starting a transmission as a master to the slave at slaveAddress
-    if (busRole != BUS_ROLE_MASTER)
-        return;
+    // the byte loaded after the last one the master read was not sent
+    if (bank.reading)
+    {
+        bank.pointer = (bank.pointer ? bank.pointer : bank.size) - 1;
+        bank.reading = false;
+    }
 
-    // Wait in case a previous message is still being sent
-    timeout = 0xFFFF;
-    while ((*pTxBufferIndex > 0) & timeout)
-        timeout--;
-        
-    if (!timeout) 
+    if (bank.written && bank.onWrite)
     {
-        /* If we can't start the transmission, then reset everything */
-        _resetBus( );
+        bank.onWrite( bank.first, bank.written );
     }
+    bank.written = 0;
+    bank.addressed = false;
+}
 
-    if (slaveAddress != this->slaveAddress)
-        _setSlaveAddress( slaveAddress );
+#if DWIRE_TRACE || DWIRE_LATENCY
+/**
+ * The DWT cycle counter, the clock of the trace and the latency histograms
+ */
+static inline uint32_t DWire_cycles( void )
+{
+    return DWT->CYCCNT;
 }
+#endif
 
+#if DWIRE_TRACE
 /**
- * Write a single byte
+ * Add an event to the trace ring of a module. Outside of the interrupt
+ * handler of the module it is called from the main thread with interrupts
+ * disabled (_trace); the timer interrupt leaves its timeouts to the main
+ * thread (_traceTimeout), which keeps a single writer at a time
  */
-void DWire::write( uint_fast8_t dataByte ) 
+static inline void DWire_trace( uint8_t m, uint8_t type, uint8_t data, uint32_t time )
 {
-    // Add data to the tx buffer
-    pTxBuffer[*pTxBufferIndex] = dataByte;
-    (*pTxBufferIndex)++;
+    DWireTrace & trace = DWire_traces[m];
+    uint16_t head = trace.head;
+    if ((uint16_t) (head - trace.tail) >= TRACE_SIZE)
+    {
+        trace.lost++;
+        return;
+    }
+
+    volatile DWireTraceEvent & event = trace.events[head & (TRACE_SIZE - 1)];
+    event.time = time;
+    event.type = type;
+    event.data = data;
+    // hand the event over to readTrace
+    trace.head = head + 1;
 }
+#endif
 
-bool DWire::endTransmission( void ) 
+/**** RECEIVED FRAMES ****/
+
+/**
+ * A byte written by the master; the first one of a frame also takes the
+ * place of its length
+ */
+static inline void DWire_frameByte( DWireFrames & frames, uint8_t data )
 {
-    return endTransmission( true );
+    if (frames.dropping)
+        return;
+
+    uint16_t fill = frames.fill;
+    if (fill == frames.head)
+    {
+        fill++;
+    }
+    // the ring is full, or the frame is longer than its length can tell
+    if ((uint16_t) (fill - frames.tail) > frames.mask || (uint16_t) (fill - frames.head) > 255)
+    {
+        frames.dropping = true;
+        return;
+    }
+    frames.ring[fill & frames.mask] = data;
+    frames.fill = fill + 1;
 }
 
 /**
- * End the transmission and transmit the tx buffer's contents over the bus
- * it returns false if succesful
+ * Called on the START or STOP that ends a frame: hand it over to
+ * readFrame, or count it as lost. Frames without data are left out
  */
-bool DWire::endTransmission( bool sendStop ) 
+static void DWire_frameEnd( uint8_t m )
 {
-    // return, if there is nothing to transmit
-    if (!*pTxBufferIndex) 
+    DWireFrames & frames = DWire_frames[m];
+    uint16_t head = frames.head;
+
+    if (frames.dropping)
     {
-        return true;
+        frames.lost++;
+        frames.dropping = false;
+    }
+    else if (frames.fill != head)
+    {
+        uint8_t length = frames.fill - head - 1;
+        frames.ring[head & frames.mask] = length;
+        DWIRE_TRACE_EVENT( m, TRACE_RECEIVE, length );
+        // the bytes are in place before readFrame can see them
+        frames.head = frames.fill;
     }
+    frames.fill = frames.head;
+}
 
-    // Wait until any ongoing (incoming) transmissions are finished
-    timeout = 0xFFFF;
-    while ( MAP_I2C_masterIsStopSent( module ) == EUSCI_B_I2C_SENDING_STOP
-            && timeout)
-        timeout--;
+#if DWIRE_LATENCY
+/**** LATENCY ****/
+
+/**
+ * The histograms of a device on a module, in a free slot if it has none
+ * yet and claim is set; 0 if there is no room
+ */
+static DWireLatency * DWire_findLatency( uint8_t m, uint8_t address, bool claim )
+{
+    DWireLatency * free = 0;
 
-    if (!timeout) 
+    for (uint8_t i = 0; i < LATENCY_DEVICES; i++)
     {
-        /* If we can't start the transmission, then reset everything */
-        _resetBus( );
-        return true;
+        DWireLatency * device = &DWire_latency[m][i];
+        if (!device->transactions)
+        {
+            free = free ? free : device;
+        }
+        else if (device->address == address)
+        {
+            return device;
+        }
     }
 
-    this->sendStop = sendStop;
-    gotNAK = false;
+    if (!claim || !free)
+        return 0;
 
-    // Clear the interrupt flags and enable
-    MAP_I2C_clearInterruptFlag( module,
-    EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT );
+    free->address = address;
+    return free;
+}
+
+static void DWire_addSample( uint16_t * histogram, uint32_t cycles )
+{
+    uint8_t n = cycles < 2 ? 0 : 31 - __builtin_clz( cycles );
+    if (n >= LATENCY_BUCKETS)
+    {
+        n = LATENCY_BUCKETS - 1;
+    }
 
-    MAP_I2C_enableInterrupt( module,
-    EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT );
+    // halve them all rather than lose the shape of the distribution
+    if (histogram[n] == 0xFFFF)
+    {
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            histogram[i] >>= 1;
+        }
+    }
+    histogram[n]++;
+}
+#endif
 
-    // Set the master into transmit mode
-    MAP_I2C_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+#if DWIRE_STATISTICS
+/**
+ * Adds the time until it goes out of scope to the waitTime of a module
+ */
+class DWireWaitTimer
+{
+    uint8_t module;
+    uint32_t start;
 
-    // Send the start condition and initial byte
-    (*pTxBufferSize) = *pTxBufferIndex;
+public:
+    DWireWaitTimer( uint8_t m ) : module( m ), start( DWire_time( ) ) { }
+    ~DWireWaitTimer( ) { DWIRE_COUNT( module, waitTime, DWire_time( ) - start ); }
+};
 
-    // Send the first byte, triggering the TX interrupt
-    MAP_I2C_masterSendMultiByteStartWithTimeout( module, pTxBuffer[0],
-    TIMEOUTLIMIT );
+#define DWIRE_WAIT_TIMER( m ) DWireWaitTimer waitTimer( m )
+#else
+#define DWIRE_WAIT_TIMER( m ) ((void) 0)
+#endif
 
-    // make sure the transmitter buffer has been flushed
-    timeout = TIMEOUTLIMIT;
-    while (*pTxBufferIndex && timeout)
-        timeout--;
+/**** ISR/IRQ Handles ****/
 
-    if (!timeout) 
+/**
+ * The interrupt handler of the Timer32: check the deadlines of all modules
+ * and run the timer towards the next one. The counter has gone on past
+ * zero, so the time is read rather than taken from DWire_timerEnd
+ */
+void DWire_timerHandler( void )
+{
+    MAP_Timer32_clearInterruptFlag( DWIRE_TIMER );
+
+    uint32_t now = DWire_now( );
+    uint32_t next = 0;
+
+    for (uint8_t m = 0; m < 4; m++)
+    {
+        DWire * instance = DWire_instances[m];
+        if (!instance)
+            continue;
+
+        uint32_t left = instance->_checkTimeout( now );
+        if (left && (!next || left < next))
+        {
+            next = left;
+        }
+    }
+
+    DWire_runTimer( next ? next : 0x7FFFFFFF );
+}
+
+/**
+ * The interrupt handler of eUSCI_B<M>, compiled for every module and role:
+ * the registers, the buffers and the role are constants, and the handler
+ * of the role is registered by begin( ).
+ */
+template <uint8_t M, uint8_t ROLE>
+void DWire_irqHandler( void )
+{
+    const uint32_t base = DWireModule<M>::base;
+    DWireBuffers & buffers = DWire_buffers[M];
+
+    uint_fast16_t status = DWire_getEnabledInterruptStatus( base );
+    DWire_clearInterruptFlag( base, status );
+
+    /* Get a reference to the correct instance */
+    /* if it is null, ignore the interrupt */
+    DWire * instance = DWire_instances[M];
+    if (!instance)
+    {
+        /* Disable all interrupts if the handler was not registered */
+        DWire_disableInterrupt( base, 0xFFFF );
+        return;
+    }
+
+    /* Another master has won the bus: the eUSCI has dropped to a slave and
+     * the transfer is over */
+    if (ROLE == BUS_ROLE_MASTER && (status & EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT))
+    {
+        if (instance->_isDMA( ))
+        {
+            instance->_abortDMA( );
+        }
+        buffers.txBufferIndex = 0;
+        buffers.rxBufferSize = 0;
+        DWIRE_COUNT( M, arbitrationLosses, 1 );
+        DWIRE_TRACE_EVENT( M, TRACE_ARBITRATION, 0 );
+        instance->_arbitrationLost( );
+        return;
+    }
+
+    /* Address-only probes as a master have a handler of their own */
+    if (ROLE == BUS_ROLE_MASTER && instance->_isProbing( ))
+    {
+        instance->_probeInterrupt( status );
+        return;
+    }
+
+    /* The START of a frame as a slave, enabled for the register bank, the
+     * frame ring, a staged response and the trace */
+    if (ROLE == BUS_ROLE_SLAVE && (status & EUSCI_B_I2C_START_INTERRUPT))
+    {
+        DWIRE_TRACE_EVENT( M, TRACE_START, EUSCI_B_CMSIS( base )->ADDRX << 1
+                | ((EUSCI_B_CMSIS( base )->CTLW0 & EUSCI_B_CTLW0_TR) ? 1 : 0) );
+        DWireBank & bank = DWire_banks[M][DWire_matched[M]];
+        if (bank.registers)
+        {
+            DWire_bankEnd( bank );
+        }
+        else if (DWire_frames[M].ring)
+        {
+            DWire_frameEnd( M );
+        }
+        DWire_responses[M].sending = 0;
+    }
+
+    /* Handle a NAK */
+    if (ROLE == BUS_ROLE_MASTER && (status & EUSCI_B_I2C_NAK_INTERRUPT))
+    {
+        /* Disable all other interrupts */
+        DWire_disableInterrupt( base,
+                EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_TRANSMIT_INTERRUPT0
+                        | EUSCI_B_I2C_NAK_INTERRUPT | EUSCI_B_I2C_STOP_INTERRUPT );
+
+        /* Stop the DMA channels, if they were moving the data */
+        if (instance->_isDMA( ))
+        {
+            instance->_abortDMA( );
+        }
+        buffers.txBufferIndex = 0;
+        buffers.rxBufferSize = 0;
+        DWIRE_COUNT( M, naks, 1 );
+        DWIRE_TRACE_EVENT( M, TRACE_NAK, 0 );
+        /* Mark the request as done and failed */
+        instance->_finishRequest( false );
+    }
+
+    /* Check for clock low interrupt: if it is low for too long, then reset the I2C peripheral */
+    /* (the other flags went with the reset) */
+    if (status & EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT)
+    {
+        DWIRE_TRACE_EVENT( M, TRACE_CLOCK_LOW, 0 );
+        instance->_handleClockLow( );
+        return;
+    }
+
+#if DWIRE_LATENCY
+    /* The first and the last byte of a transfer as a master */
+    if (ROLE == BUS_ROLE_MASTER
+            && (status & (EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_TRANSMIT_INTERRUPT0)))
+    {
+        instance->_markByte( );
+    }
+#endif
+
+    /* As a slave, own address n raises RXIFGn and TXIFGn: they are handled
+     * as those of address 0, for the address that matched */
+    uint8_t matched = 0;
+    if (ROLE == BUS_ROLE_SLAVE && (status & (DWire_addressFlags[0] | DWire_addressFlags[1]
+            | DWire_addressFlags[2] | DWire_addressFlags[3])))
+    {
+        while (!(status & DWire_addressFlags[matched]))
+        {
+            matched++;
+        }
+        if (matched)
+        {
+            status |= (status & DWire_addressFlags[matched]) >> (6 + 2 * matched);
+        }
+        DWire_matched[M] = matched;
+    }
+
+    /* RXIFG */
+    /* Triggered when data has been received */
+    if (status & EUSCI_B_I2C_RECEIVE_INTERRUPT0)
+    {
+        /* If we're a slave, then we're receiving data from the master */
+        if (ROLE == BUS_ROLE_SLAVE)
+        {
+            uint8_t data = DWire_slaveGetData( base );
+            DWIRE_COUNT( M, bytesRx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_RX, data );
+            if (DWire_banks[M][matched].registers)
+            {
+                DWire_bankWrite( DWire_banks[M][matched], data );
+            }
+            /* the frame ring and the staged response serve address 0 */
+            else if (DWire_frames[M].ring && !matched)
+            {
+                DWire_frameByte( DWire_frames[M], data );
+            }
+            else
+            {
+                // read( ) moves the index on as well: a new frame starts over
+                if (!buffers.rxFrame)
+                {
+                    buffers.rxFrame = true;
+                    buffers.rxBufferIndex = 0;
+                }
+                buffers.rxBuffer[buffers.rxBufferIndex] = data;
+                buffers.rxBufferIndex++;
+            }
+        }
+        /* A streaming read hands every byte to the user */
+        else if (instance->_isStreaming( ))
+        {
+            uint8_t data = DWire_masterReceiveMultiByteNext( base );
+            DWIRE_COUNT( M, bytesRx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_RX, data );
+            instance->_streamReceive( data );
+        }
+        /* As a master, we're handling the slave response after/during a request */
+        else
+        {
+            /* do range checking around this block to avoid possible errors */
+            uint8_t data = DWire_masterReceiveMultiByteNext( base );
+            uint8_t end = buffers.rxBufferSize + buffers.rxDrop;
+            /* the bytes past the end of the buffer are dropped */
+            if (buffers.rxBufferIndex < buffers.rxBufferSize)
+            {
+                buffers.rxData[buffers.rxBufferIndex] = data;
+            }
+            buffers.rxBufferIndex++;
+            DWIRE_COUNT( M, bytesRx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_RX, data );
+
+            /* if we only need to read 1 more byte, start sending a stop */
+            /* (or the repeated START of the next message), unless the */
+            /* byte counter does */
+            if (buffers.rxBufferIndex == end - 1)
+            {
+                if (instance->_isMessage( ))
+                {
+                    instance->_endMessage( );
+                }
+                else if (!instance->_isCounterStop( ))
+                {
+                    DWire_masterReceiveMultiByteStop( base );
+                }
+            }
+
+            if (buffers.rxBufferIndex == end)
+            {
+                if (instance->_isMessage( ))
+                {
+                    /* Continue with the next message */
+                    instance->_nextMessage( );
+                }
+                else
+                {
+                    /* Disable the RX interrupt */
+                    DWire_disableInterrupt( base,
+                            EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+                    /* Mark the request as done and succesful */
+                    /* (asynchronous requests once the STOP is out) */
+                    if (!instance->_isAsync( ))
+                    {
+                        instance->_finishRequest( true );
+                    }
+                }
+            }
+        }
+    }
+
+    /* As master: triggered when a byte has been transmitted */
+    if (status & EUSCI_B_I2C_TRANSMIT_INTERRUPT0)
+    {
+        /* If we're a slave, then we're handling a request from the master */
+        if (ROLE == BUS_ROLE_SLAVE && DWire_banks[M][matched].registers)
+        {
+            uint8_t data = DWire_bankRead( DWire_banks[M][matched] );
+            DWire_slavePutData( base, data );
+            DWIRE_COUNT( M, bytesTx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_TX, data );
+        }
+        /* A staged response goes out without asking the user */
+        else if (ROLE == BUS_ROLE_SLAVE && DWire_responses[M].published && !matched)
+        {
+            uint8_t data = DWire_responseByte( DWire_responses[M] );
+            DWire_slavePutData( base, data );
+            DWIRE_COUNT( M, bytesTx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_TX, data );
+        }
+        else if (ROLE == BUS_ROLE_SLAVE)
+        {
+            instance->_handleRequestSlave( );
+        }
+        /* A streaming write asks the user for every byte */
+        else if (instance->_isStreaming( ))
+        {
+            instance->_streamTransmit( );
+        }
+        /* The START of a message has been sent, its first byte can follow */
+        else if (instance->_isFirstPending( ))
+        {
+            instance->_sendFirstByte( );
+        }
+        else if (buffers.txBufferIndex == 1)
+        {
+            /* Send a STOP condition if required */
+            if (instance->_isSendStop( ))
+            {
+                DWire_masterSendMultiByteStop( base );
+            }
+            /* Disable the TX interrupt */
+            DWire_disableInterrupt( base,
+                    EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT );
+            buffers.txBufferIndex--;
+            instance->_finishTransmit( );
+        }
+        else if (buffers.txBufferIndex > 1)
+        {
+            /* If we still have data left in the buffer, then transmit that */
+            uint8_t data = buffers.txData[buffers.txBufferSize - buffers.txBufferIndex + 1];
+            DWire_masterSendMultiByteNext( base, data );
+            buffers.txBufferIndex--;
+            DWIRE_COUNT( M, bytesTx, 1 );
+            DWIRE_TRACE_EVENT( M, TRACE_TX, data );
+        }
+    }
+
+    /* STPIFG: Called when a STOP is received */
+    if (status & EUSCI_B_I2C_STOP_INTERRUPT)
+    {
+        DWIRE_TRACE_EVENT( M, TRACE_STOP, 0 );
+        if (ROLE == BUS_ROLE_SLAVE)
+        {
+            DWIRE_COUNT( M, transactions, 1 );
+            DWire_responses[M].sending = 0;
+        }
+
+        /* As master, only enabled for DMA and asynchronous transfers */
+        if (ROLE == BUS_ROLE_MASTER)
+        {
+            instance->_finishStop( );
+        }
+        else if (DWire_banks[M][DWire_matched[M]].registers)
+        {
+            DWire_bankEnd( DWire_banks[M][DWire_matched[M]] );
+        }
+        else if (DWire_frames[M].ring && !DWire_matched[M])
+        {
+            DWire_frameEnd( M );
+        }
+        else if (buffers.txBufferIndex != 0)
+        {
+            buffers.rxBufferIndex = 0;
+            buffers.rxBufferSize = 0;
+            buffers.rxFrame = false;
+        }
+        else if (buffers.rxFrame)
+        {
+            instance->_handleReceive( );
+        }
+    }
+}
+
+/**** CONSTRUCTORS ****/
+DWire::DWire( uint8_t mod ) 
+{
+	switch (mod) 
+    {
+        case 0:
+        	_bind<0, BUS_ROLE_ANY>( );
+            break;
+
+        case 2:
+            _bind<2, BUS_ROLE_ANY>( );
+            break;
+            
+        case 3:
+            _bind<3, BUS_ROLE_ANY>( );
+            break;
+            
+        case 1:
+        default:
+            _bind<1, BUS_ROLE_ANY>( );
+            break;
+    }
+    _initState( );
+}
+
+DWire::DWire( ) 
+{
+	// set default settings
+    _bind<1, BUS_ROLE_ANY>( );
+    _initState( );
+}
+
+DWire::DWire( void (DWire::*bind)( void ) ) 
+{
+    (this->*bind)( );
+    _initState( );
+}
+
+/**
+ * Put a new DWire in its default settings, after _bind
+ */
+void DWire::_initState( void ) 
+{
+    this->mode = FAST;
+    this->dmaEnabled = false;
+    this->lowPower = false;
+    this->byteCounterArmed = false;
+    this->autoStop = false;
+    this->asyncTransfer = false;
+    this->readPending = false;
+    this->blocking = false;
+    this->message = 0;
+    this->messagesLeft = 0;
+    this->firstPending = false;
+    this->streaming = false;
+    this->probing = false;
+    this->probeAddress = 0;
+    this->streamCount = 0;
+    this->asyncStatus = TRANSFER_SUCCESS;
+    this->asyncCount = 0;
+    this->user_onComplete = 0;
+    this->user_onClockLow = 0;
+    memset( this->user_onRequest, 0, sizeof(this->user_onRequest) );
+    memset( this->user_onReceive, 0, sizeof(this->user_onReceive) );
+    this->ownAddressCount = 0;
+    this->clockLowPolicy = CLOCK_LOW_RESET_MODULE;
+    this->clockLowPending = false;
+    this->current = 0;
+    this->counterStop = false;
+    this->queueHead = 0;
+    this->queueTail = 0;
+    this->timeoutMicros = DEFAULT_TIMEOUT;
+    this->timeoutTicks = 0;
+    this->watching = false;
+    this->expired = false;
+    this->recoveryPending = false;
+    this->recoveryTicks = 0;
+    this->timeoutTracePending = false;
+}
+
+DWire::~DWire( ) 
+{
+	/* Reset the module */
+    MAP_I2C_disableModule( module );
+    
+    /* Deregister from the moduleMap */
+    DWire_instances[moduleIndex] = 0;
+}
+
+/**** PUBLIC METHODS ****/
+
+void DWire::begin( ) 
+{
+    // a DWireT bound to the slave role has no handler for a master
+    if (!masterHandler)
+        return;
+
+    // Initialising the given module as a master
+    busRole = BUS_ROLE_MASTER;
+    slaveAddress = 0;
+    _initMain( );
+
+    if (dmaEnabled)
+    {
+        _initDMA( );
+    }
+
+    // calculate the number of iterations of a loop to generate
+    // a delay of about 1us based on clock speed
+    // this is needed to clock the bus free in _resetBus in a way that is
+    // independent of CPU speed and OS (Energia or not)
+	delayCycles = MAP_CS_getMCLK( ) / 7905857;
+	_initTimeout( );
+
+#if DWIRE_TRACE || DWIRE_LATENCY
+    // the cycle counter of the trace and the latency histograms
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	
+	/* Set the EUSCI configuration */
+	config.selectClockSource = EUSCI_B_I2C_CLOCKSOURCE_SMCLK;	// SMCLK Clock Source
+	config.i2cClk = MAP_CS_getSMCLK( );							// Get the SMCLK clock frequency
+	config.byteCounterThreshold = 0;							// No byte counter threshold
+	config.autoSTOPGeneration = EUSCI_B_I2C_NO_AUTO_STOP;		// No Autostop
+	
+    if (mode == FAST) 
+    {
+    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_400KBPS;
+    	
+        _initMaster( &config );
+		// half a clock period
+        delayCycles = delayCycles * 2;
+    } 
+    else if(mode == FASTPLUS) 
+    {
+    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_1MBPS;
+    	
+        _initMaster( &config );
+        // half a clock period
+    } 
+    else 
+    {
+    	config.dataRate = EUSCI_B_I2C_SET_DATA_RATE_100KBPS;
+    	
+        _initMaster( &config );
+        // half a clock period
+        delayCycles = delayCycles * 5;
+    }
+}
+
+void DWire::setStandardMode( ) 
+{
+    this->mode = STANDARD;
+}
+
+void DWire::setFastMode( ) 
+{
+    this->mode = FAST;
+}
+
+void DWire::setFastModePlus( ) 
+{
+    this->mode = FASTPLUS;
+}
+
+/**
+ * Let the uDMA controller move the data of master transfers, so the CPU
+ * is only interrupted when a transfer has ended or was NAKed.
+ * eUSCI_Bn uses DMA channels 2n (TX) and 2n + 1 (RX). Call before begin( )
+ */
+void DWire::enableDMA( void ) 
+{
+#if DWIRE_DMA_TABLE
+    // share the control table of the application, if it has one
+    if (!MAP_DMA_getControlBase( ))
+    {
+        MAP_DMA_setControlBase( DWire_dmaControlTable );
+    }
+#endif
+    this->dmaEnabled = true;
+}
+
+void DWire::disableDMA( void ) 
+{
+    this->dmaEnabled = false;
+}
+
+/**
+ * Returns how long the last bus recovery took in microseconds, from the
+ * abandoned transfer until the bus was free again
+ */
+uint32_t DWire::recoveryTime( void ) 
+{
+    return (uint64_t) recoveryTicks * 16 * 1000000 / MAP_CS_getMCLK( );
+}
+
+/**
+ * Take a snapshot of the counters of the module
+ */
+void DWire::statistics( DWireStatistics * snapshot ) 
+{
+#if DWIRE_STATISTICS
+    bool disabled = MAP_Interrupt_disableMaster( );
+    *snapshot = DWire_statistics[moduleIndex];
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+    // in two steps, which cannot overflow
+    uint32_t rate = MAP_CS_getMCLK( ) / 16;
+    uint64_t ticks = snapshot->waitTime;
+    snapshot->waitTime = ticks / rate * 1000000 + ticks % rate * 1000000 / rate;
+#else
+    memset( snapshot, 0, sizeof(DWireStatistics) );
+#endif
+}
+
+/**
+ * Set the counters of the module back to 0
+ */
+void DWire::clearStatistics( void ) 
+{
+#if DWIRE_STATISTICS
+    bool disabled = MAP_Interrupt_disableMaster( );
+    memset( &DWire_statistics[moduleIndex], 0, sizeof(DWireStatistics) );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+#endif
+}
+
+/**
+ * Take up to max events out of the trace ring of the module (DWIRE_TRACE),
+ * oldest first, with their times in microseconds. Returns the number of
+ * events; events that came in while the ring was full are only counted,
+ * see traceLost
+ */
+uint8_t DWire::readTrace( DWireTraceEvent * events, uint8_t max ) 
+{
+#if DWIRE_TRACE
+    DWireTrace & trace = DWire_traces[moduleIndex];
+    uint16_t tail = trace.tail;
+    uint16_t available = trace.head - tail;
+    uint8_t count = available < max ? available : max;
+    if (!count)
+        return 0;
+
+    uint32_t mclk = MAP_CS_getMCLK( );
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        volatile DWireTraceEvent & event = trace.events[(tail + i) & (TRACE_SIZE - 1)];
+        // the cycle counter wraps around within 90 s at 48 MHz, the count
+        // goes on from the event before (in two steps, which cannot overflow)
+        trace.cycles += (uint32_t) (event.time - trace.last);
+        trace.last = event.time;
+        events[i].time = trace.cycles / mclk * 1000000 + trace.cycles % mclk * 1000000 / mclk;
+        events[i].type = event.type;
+        events[i].data = event.data;
+    }
+
+    // the slots can be written again
+    trace.tail = tail + count;
+    return count;
+#else
+    (void) events;
+    (void) max;
+    return 0;
+#endif
+}
+
+/**
+ * Returns the number of events dropped because the trace ring was full
+ */
+uint32_t DWire::traceLost( void ) 
+{
+#if DWIRE_TRACE
+    return DWire_traces[moduleIndex].lost;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Copy the latency histograms of a device (DWIRE_LATENCY), in cycles of
+ * MCLK. Returns the number of transactions they cover, 0 if the device
+ * has none
+ */
+uint32_t DWire::latency( uint_fast8_t address, DWireLatency * histograms ) 
+{
+    memset( histograms, 0, sizeof(DWireLatency) );
+#if DWIRE_LATENCY
+    bool disabled = MAP_Interrupt_disableMaster( );
+    DWireLatency * device = DWire_findLatency( moduleIndex, address, false );
+    if (device)
+    {
+        *histograms = *device;
+    }
+
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+#else
+    (void) address;
+#endif
+    return histograms->transactions;
+}
+
+/**
+ * Returns the latency in cycles that percent of the transactions with a
+ * device did not exceed in a phase (LATENCY_...), rounded up to the end
+ * of its bucket; 0 without any
+ */
+uint32_t DWire::latencyPercentile( uint_fast8_t address, uint8_t phase, uint8_t percent ) 
+{
+    DWireLatency device;
+    if (phase >= LATENCY_PHASES || !latency( address, &device ))
+        return 0;
+
+    const uint16_t * histogram = device.histogram[phase];
+    uint32_t total = 0;
+    for (uint8_t n = 0; n < LATENCY_BUCKETS; n++)
+    {
+        total += histogram[n];
+    }
+
+    uint32_t wanted = (total * percent + 99) / 100;
+    uint32_t count = 0;
+    for (uint8_t n = 0; n < LATENCY_BUCKETS; n++)
+    {
+        count += histogram[n];
+        if (count && count >= wanted)
+        {
+            return (2UL << n) - 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Drop the latency histograms of all devices of the module
+ */
+void DWire::clearLatency( void ) 
+{
+#if DWIRE_LATENCY
+    bool disabled = MAP_Interrupt_disableMaster( );
+    memset( DWire_latency[moduleIndex], 0, sizeof(DWire_latency[moduleIndex]) );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+#endif
+}
+
+/**
+ * Let the blocking master calls sleep in LPM0 until an interrupt (of DWire,
+ * its timeout timer or anything else) wakes the CPU, instead of polling
+ */
+void DWire::enableLowPower( void ) 
+{
+    this->lowPower = true;
+}
+
+void DWire::disableLowPower( void ) 
+{
+    this->lowPower = false;
+}
+
+/**
+ * Set the timeout of master transfers in microseconds, 0 to wait forever.
+ * A transfer that has not moved on for this long is abandoned and the bus
+ * reset, an asynchronous or queued one on the next blocking call or
+ * process( ). The wait for the STOP of the transfer before and the poll
+ * for the START still count TIMEOUTLIMIT rounds
+ */
+void DWire::setTimeout( uint32_t microseconds ) 
+{
+    this->timeoutMicros = microseconds;
+    _initTimeout( );
+}
+
+/**
+ * Returns true if the last master transfer was abandoned on its timeout
+ */
+bool DWire::timedOut( void ) 
+{
+    return expired;
+}
+
+void DWire::begin( uint8_t address ) 
+{
+    begin( &address, 1 );
+}
+
+/**
+ * Begin as a slave answering to count (at most OWN_ADDRESSES) addresses.
+ * Each of them has its own onReceive and onRequest handlers or register
+ * bank, set after begin with the address; the handlers set without an
+ * address belong to the first one, as do the frame ring and the staged
+ * response
+ */
+void DWire::begin( const uint8_t * addresses, uint8_t count ) 
+{
+    // a DWireT bound to the master role has no handler for a slave
+    if (!slaveHandler)
+        return;
+
+    // Initialising the given module as a slave
+    busRole = BUS_ROLE_SLAVE;
+    ownAddressCount = count > OWN_ADDRESSES ? OWN_ADDRESSES : count;
+    memset( ownAddresses, 0, sizeof(ownAddresses) );
+    memcpy( ownAddresses, addresses, ownAddressCount );
+    slaveAddress = ownAddresses[0];
+
+    _initMain( );
+#if DWIRE_TRACE
+    // the timestamps of the trace
+    _initTimeout( );
+#endif
+
+    _initSlave( );
+}
+
+/**
+ * Begin a transmission as a master
+ */
+void DWire::beginTransmission( uint_fast8_t slaveAddress ) 
+{
+    // Starting a transmission as a master to the slave at slaveAddress
+    if (busRole != BUS_ROLE_MASTER)
+        return;
+
+    // Wait in case an asynchronous or queued transfer is still going on;
+    // it ends by itself, at the latest on its timeout. Anything written
+    // since an earlier beginTransmission is dropped
+    if (asyncTransfer)
+    {
+        DWIRE_WAIT_TIMER( moduleIndex );
+        _wait( &DWire::_isAsync );
+    }
+    *pTxBufferIndex = 0;
+
+    if (slaveAddress != this->slaveAddress)
+        _setSlaveAddress( slaveAddress );
+
+    *pTxData = pTxBuffer;
+}
+
+/**
+ * Write a single byte
+ */
+void DWire::write( uint_fast8_t dataByte ) 
+{
+    // Continue in the tx buffer after data written from a caller's buffer
+    if (*pTxData != pTxBuffer)
+    {
+        memcpy( pTxBuffer, *pTxData, *pTxBufferIndex );
+        *pTxData = pTxBuffer;
+    }
+
+    // Add data to the tx buffer
+    pTxBuffer[*pTxBufferIndex] = dataByte;
+    (*pTxBufferIndex)++;
+}
+
+/**
+ * Write a block of bytes. As master, if it is the first write after
+ * beginTransmission, the data is sent straight from the caller's buffer,
+ * which must not change until the transmission has ended.
+ * It returns the number of bytes accepted
+ */
+size_t DWire::write( const uint8_t * data, size_t length ) 
+{
+    // the size of a transfer is limited by the 8-bit buffer index
+    size_t room = 0xFF - *pTxBufferIndex;
+    if (length > room)
+    {
+        length = room;
+    }
+
+    if (!*pTxBufferIndex && busRole == BUS_ROLE_MASTER)
+    {
+        *pTxData = (uint8_t *) data;
+    }
+    else
+    {
+        if (*pTxData != pTxBuffer)
+        {
+            memcpy( pTxBuffer, *pTxData, *pTxBufferIndex );
+            *pTxData = pTxBuffer;
+        }
+        memcpy( pTxBuffer + *pTxBufferIndex, data, length );
+    }
+    *pTxBufferIndex += length;
+    return length;
+}
+
+bool DWire::endTransmission( void ) 
+{
+    return endTransmission( true );
+}
+
+/**
+ * End the transmission and transmit the tx buffer's contents over the bus
+ * it returns false if succesful
+ */
+bool DWire::endTransmission( bool sendStop ) 
+{
+    // return, if there is nothing to transmit
+    if (!*pTxBufferIndex) 
+    {
+        return true;
+    }
+
+    DWIRE_WAIT_TIMER( moduleIndex );
+    _startTimeout( );
+    if (_startTransmission( sendStop ))
+    {
+        return true;
+    }
+
+    // make sure the transmitter buffer has been flushed
+    _wait( &DWire::_isSending );
+    watching = false;
+
+    if (*pTxBufferIndex) 
+    {
+        _resetBus( );
+        return true;
+    }
+
+    return gotNAK;
+}
+
+bool DWire::endTransmissionAsync( void ) 
+{
+    return endTransmissionAsync( true );
+}
+
+/**
+ * Start transmitting the tx buffer's contents and return immediately.
+ * The outcome is reported through onComplete and transferStatus.
+ * It returns false if the transmission was started
+ */
+bool DWire::endTransmissionAsync( bool sendStop ) 
+{
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer || !*pTxBufferIndex)
+        return true;
+
+    _beginAsync( );
+    if (_startTransmission( sendStop ))
+    {
+        asyncTransfer = false;
+        asyncStatus = TRANSFER_FAILED;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Request data from a SLAVE as a MASTER. A request of 0 bytes returns 0
+ * without touching the bus
+ */
+uint8_t DWire::requestFrom( uint_fast8_t slaveAddress, uint_fast8_t numBytes ) 
+{
+    // No point of doing anything else if there we're not a MASTER
+    if (busRole != BUS_ROLE_MASTER || !numBytes)
+        return 0;
+
+    DWIRE_WAIT_TIMER( moduleIndex );
+
+    // Wait for any asynchronous or queued transfer to finish
+    _wait( &DWire::_isAsync );
+
+    bool dma = _prepareRequest( numBytes );
+    requestDone = false;
+    _startTimeout( );
+
+    // still something to send? Flush the TX buffer but do not send a STOP
+    if (*pTxBufferIndex > 0) 
+    {
+        // this is a repeated start, which the ISR sends after the last
+        // byte: no point in trying to receive if the transmission fails
+        readAddress = slaveAddress;
+        readBytes = numBytes;
+        readDMA = dma;
+        readPending = true;
+
+        byteCounterArmed = counterStop;
+        bool failed = _startTransmission( false );
+        byteCounterArmed = false;
+        if (failed)
+        {
+            readPending = false;
+            return 0;
+        }
+    } 
+    else 
+    {
+        // Wait until any request is finished
+        if (!_awaitStop( )) 
+        {
+            /* If we get a timeout, then reset everything */
+            _resetBus( );
+            return 0;
+        }
+
+        _startRequest( slaveAddress, numBytes, dma );
+    }
+
+    // Wait until the request is done
+    _wait( &DWire::_isRequesting );
+    readPending = false;
+
+    if (!requestDone)
+    {
+        /* If we get a timeout, then reset everything */
+        _resetBus( );
+        return 0;
+    }
+
+    return gotNAK ? 0 : *pRxBufferSize;
+}
+
+/**
+ * Request data from a SLAVE as a MASTER, received straight into the
+ * caller's buffer instead of the rx buffer
+ */
+uint8_t DWire::requestFrom( uint_fast8_t slaveAddress, uint8_t * buffer,
+        uint_fast8_t numBytes ) 
+{
+    if (busRole != BUS_ROLE_MASTER || !numBytes)
+        return 0;
+
+    // The ISR may still use the pointer for a queued transfer
+    _wait( &DWire::_isAsync );
+
+    *pRxData = buffer;
+    uint8_t count = requestFrom( slaveAddress, numBytes );
+    *pRxData = pRxBuffer;
+    *pRxBufferSize = 0;
+    return count;
+}
+
+/**
+ * Start a request and return immediately; pending bytes in the tx buffer
+ * are sent first, followed by a repeated START. The outcome is reported
+ * through onComplete and transferStatus, after which the data can be
+ * read( ). It returns false if the request was started, and true for a
+ * request of 0 bytes
+ */
+bool DWire::requestFromAsync( uint_fast8_t slaveAddress, uint_fast8_t numBytes ) 
+{
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer || !numBytes)
+        return true;
+
+    bool dma = _prepareRequest( numBytes );
+    _beginAsync( );
+
+    if (*pTxBufferIndex > 0) 
+    {
+        // the ISR starts the read after the last byte
+        readAddress = slaveAddress;
+        readBytes = numBytes;
+        readDMA = dma;
+        readPending = true;
+
+        byteCounterArmed = counterStop;
+        bool failed = _startTransmission( false );
+        byteCounterArmed = false;
+        if (!failed)
+        {
+            return false;
+        }
+        readPending = false;
+    }
+    else 
+    {
+        if (_awaitStop( )) 
+        {
+            _startRequest( slaveAddress, numBytes, dma );
+            return false;
+        }
+        _resetBus( );
+    }
+
+    asyncTransfer = false;
+    asyncStatus = TRANSFER_FAILED;
+    return true;
+}
+
+/**
+ * Run a list of messages as one combined transfer, like I2C_RDWR on Linux.
+ * The messages are joined by repeated STARTs and the ISR moves on from one
+ * to the next, with a STOP after the last one. It returns true on failure
+ */
+bool DWire::transfer( DWireMessage * messages, uint8_t count ) 
+{
+    if (busRole != BUS_ROLE_MASTER)
+        return true;
+
+    DWIRE_WAIT_TIMER( moduleIndex );
+
+    // Wait for any asynchronous or queued transfer to finish
+    _wait( &DWire::_isAsync );
+
+    blocking = true;
+    bool failed = transferAsync( messages, count );
+    if (!failed)
+    {
+        _wait( &DWire::_isRunning );
+
+        if (asyncStatus == TRANSFER_PENDING) 
+        {
+            _resetBus( );
+        }
+        failed = asyncStatus != TRANSFER_SUCCESS;
+    }
+    blocking = false;
+    return failed;
+}
+
+/**
+ * Start a combined transfer and return immediately. The outcome is
+ * reported through onComplete and transferStatus; the messages and their
+ * data must stay valid until then. It returns false if it was started
+ */
+bool DWire::transferAsync( DWireMessage * messages, uint8_t count ) 
+{
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer
+            || _checkMessages( messages, count ))
+        return true;
+
+    _beginAsync( );
+    return _startMessages( messages, count );
+}
+
+/**
+ * Read from a register of a slave: the register address is written and
+ * the data read after a repeated START. A single byte takes two bytes on
+ * the bus, see _prepareRequest. It returns true on failure
+ */
+bool DWire::readRegister( uint_fast8_t slaveAddress, uint8_t reg, uint8_t * data,
+        uint8_t length ) 
+{
+    DWireMessage messages[2] = {
+            { (uint8_t) slaveAddress, MESSAGE_WRITE, 1, &reg },
+            { (uint8_t) slaveAddress, MESSAGE_READ, length, data } };
+
+    return transfer( messages, 2 );
+}
+
+/**
+ * Write to a register of a slave, the data following the register
+ * address in the same message. It returns true on failure
+ */
+bool DWire::writeRegister( uint_fast8_t slaveAddress, uint8_t reg, const uint8_t * data,
+        uint8_t length ) 
+{
+    DWireMessage messages[2] = {
+            { (uint8_t) slaveAddress, MESSAGE_WRITE, 1, &reg },
+            { (uint8_t) slaveAddress, MESSAGE_WRITE | MESSAGE_NOSTART, length,
+                    (uint8_t *) data } };
+
+    return transfer( messages, length ? 2 : 1 );
+}
+
+bool DWire::writeRegister( uint_fast8_t slaveAddress, uint8_t reg, uint8_t value ) 
+{
+    return writeRegister( slaveAddress, reg, &value, 1 );
+}
+
+/**
+ * Reads a single byte from the rx buffer
+ */
+uint8_t DWire::read( void ) 
+{
+    // Return a 0 if there is nothing to read or if the index is out of bounds
+    if ((*pRxBufferSize == 0) || (*pRxBufferIndex >= *pRxBufferSize) )
+    {
+    	*pRxBufferSize = 0;
+        return 0;
+    }
+    // return the next byte and increment the index
+    // bounds checking is done at the next iteration of read
+    return pRxBuffer[(*pRxBufferIndex)++];
+}
+
+/**
+ * Returns the own address the master has addressed in the current or the
+ * last frame, see begin( addresses, count )
+ */
+uint8_t DWire::matchedAddress( void ) 
+{
+    return ownAddresses[DWire_matched[moduleIndex]];
+}
+
+/**
+ * Register the user's interrupt handler
+ */
+void DWire::onRequest( void (*islHandle)( void ) ) 
+{
+    user_onRequest[0] = islHandle;
+}
+
+/**
+ * Register the interrupt handler
+ * The argument contains the number of bytes received
+ */
+void DWire::onReceive( void (*islHandle)( uint8_t ) ) 
+{
+    user_onReceive[0] = islHandle;
+}
+
+/**
+ * Register the request handler of one of the own addresses. It returns
+ * true if address is not one of them
+ */
+bool DWire::onRequest( uint8_t address, void (*islHandle)( void ) ) 
+{
+    int8_t n = _ownAddress( address );
+    if (n < 0)
+        return true;
+
+    user_onRequest[n] = islHandle;
+    return false;
+}
+
+/**
+ * Register the receive handler of one of the own addresses. It returns
+ * true if address is not one of them
+ */
+bool DWire::onReceive( uint8_t address, void (*islHandle)( uint8_t ) ) 
+{
+    int8_t n = _ownAddress( address );
+    if (n < 0)
+        return true;
+
+    user_onReceive[n] = islHandle;
+    return false;
+}
+
+/**
+ * Register the handler called from process( ) once the slave has recovered
+ * from SCL being held low for too long (see setClockLowPolicy)
+ */
+void DWire::onClockLow( void (*islHandle)( void ) ) 
+{
+    user_onClockLow = islHandle;
+}
+
+/**
+ * Set what a slave does when SCL is held low for too long:
+ * CLOCK_LOW_RESET_MODULE (the default) or CLOCK_LOW_HARD_RESET
+ */
+void DWire::setClockLowPolicy( uint8_t policy ) 
+{
+    clockLowPolicy = policy;
+}
+
+/**
+ * Serve the master from a bank of size registers (at most 256) as a slave,
+ * entirely from the ISR, instead of through onReceive and onRequest: the
+ * first byte of a write sets the register pointer, further bytes are
+ * written to the registers and reads return them, both moving the pointer
+ * on and wrapping at the end. Only the bits set in writable[n] can be
+ * written to register n; without writable, all of them can. The bank
+ * serves the first own address; a bank of 0 registers ends it
+ */
+void DWire::registerBank( uint8_t * registers, uint16_t size, const uint8_t * writable ) 
+{
+    _registerBank( 0, registers, size, writable );
+}
+
+/**
+ * Called from the ISR at the end of a frame in which the master has
+ * written to the register bank, with the first register and the count
+ */
+void DWire::onRegisterWrite( void (*islHandle)( uint8_t, uint8_t ) ) 
+{
+    DWire_banks[moduleIndex][0].onWrite = islHandle;
+}
+
+/**
+ * Serve one of the own addresses from a register bank, after begin( 
+ * addresses, count ); see registerBank( registers, size, writable ).
+ * It returns true if address is not one of them
+ */
+bool DWire::registerBank( uint8_t address, uint8_t * registers, uint16_t size,
+        const uint8_t * writable ) 
+{
+    int8_t n = _ownAddress( address );
+    if (n < 0)
+        return true;
+
+    _registerBank( n, registers, size, writable );
+    return false;
+}
+
+/**
+ * Register the handler of onRegisterWrite for the bank of one of the own
+ * addresses. It returns true if address is not one of them
+ */
+bool DWire::onRegisterWrite( uint8_t address, void (*islHandle)( uint8_t, uint8_t ) ) 
+{
+    int8_t n = _ownAddress( address );
+    if (n < 0)
+        return true;
+
+    DWire_banks[moduleIndex][n].onWrite = islHandle;
+    return false;
+}
+
+/**
+ * Returns the buffer (of RESPONSE_SIZE bytes) to fill with the next staged
+ * response as a slave, see publishResponse. It is 0 while both buffers are
+ * taken: one published, the other one still being sent
+ */
+uint8_t * DWire::responseBuffer( void ) 
+{
+    DWireResponse & response = DWire_responses[moduleIndex];
+    uint8_t published = response.published;
+    uint8_t sending = response.sending;
+
+    for (uint8_t n = 0; n < 2; n++)
+    {
+        if (published != n + 1 && sending != n + 1)
+        {
+            return response.data[n];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Publish the first length bytes of the buffer of responseBuffer as the
+ * response of a slave. From the next read on, the ISR sends it as soon as
+ * the master has addressed it, without calling onRequest, until another
+ * response is published. It returns true if there was no buffer to publish
+ */
+bool DWire::publishResponse( uint8_t length ) 
+{
+    DWireResponse & response = DWire_responses[moduleIndex];
+    uint8_t * buffer = responseBuffer( );
+    if (!buffer || length > RESPONSE_SIZE)
+        return true;
+
+    uint8_t n = buffer == response.data[0] ? 0 : 1;
+    bool enabled = MAP_Interrupt_isEnabled( intModule );
+    MAP_Interrupt_disableInterrupt( intModule );
+    response.length[n] = length;
+    response.published = n + 1;
+    if (enabled)
+    {
+        MAP_Interrupt_enableInterrupt( intModule );
+    }
+
+    // a repeated START has to end a read as well
+    if (busRole == BUS_ROLE_SLAVE)
+    {
+        MAP_I2C_enableInterrupt( module, EUSCI_B_I2C_START_INTERRUPT );
+    }
+    return false;
+}
+
+/**
+ * Collect the frames written by the master as a slave in a ring of size
+ * bytes (a power of two, at most 32768), instead of calling onReceive. The
+ * ISR stores every frame with its length, so that back-to-back writes
+ * wait there until the main loop takes them out with readFrame. A frame
+ * that does not fit is dropped and counted, see framesLost. Other sizes
+ * are rounded down to a power of two. A ring of 0 bytes goes back to
+ * onReceive
+ */
+void DWire::receiveFrames( uint8_t * ring, uint16_t size )
+{
+    DWireFrames & frames = DWire_frames[moduleIndex];
+
+    bool enabled = MAP_Interrupt_isEnabled( intModule );
+    MAP_Interrupt_disableInterrupt( intModule );
+    memset( &frames, 0, sizeof(DWireFrames) );
+    // the indexes are masked, which needs a power of two
+    while (size & (size - 1))
+    {
+        size &= size - 1;
+    }
+    if (ring && size > 1)
+    {
+        frames.mask = size - 1;
+        frames.ring = ring;
+    }
+    if (enabled)
+    {
+        MAP_Interrupt_enableInterrupt( intModule );
+    }
+
+    // a repeated START has to end a frame as well
+    if (frames.ring && busRole == BUS_ROLE_SLAVE)
+    {
+        MAP_I2C_enableInterrupt( module, EUSCI_B_I2C_START_INTERRUPT );
+    }
+}
+
+/**
+ * Take the oldest frame out of the ring of receiveFrames, copying up to
+ * size bytes of it to buffer. It returns the length of the frame, 0 if
+ * there is none
+ */
+uint8_t DWire::readFrame( uint8_t * buffer, uint8_t size )
+{
+    DWireFrames & frames = DWire_frames[moduleIndex];
+    uint16_t tail = frames.tail;
+    if (!frames.ring || tail == frames.head)
+        return 0;
+
+    uint8_t length = frames.ring[tail & frames.mask];
+    for (uint8_t i = 0; i < length && i < size; i++)
+    {
+        buffer[i] = frames.ring[(tail + 1 + i) & frames.mask];
+    }
+    // hand the space back to the ISR
+    frames.tail = tail + 1 + length;
+    return length;
+}
+
+/**
+ * Returns the number of frames dropped because the ring of receiveFrames
+ * was full (or the frame longer than 255 bytes) or the clock was held low
+ */
+uint32_t DWire::framesLost( void )
+{
+    return DWire_frames[moduleIndex].lost;
+}
+
+/**
+ * Start a streaming write and return immediately: the ISR asks source for
+ * every next byte, until it returns false. The transfer is not limited to
+ * the size of the tx buffer. The outcome is reported through onComplete
+ * and transferStatus. It returns false if the transfer was started
+ */
+bool DWire::writeStreamAsync( uint_fast8_t slaveAddress, bool (*source)( uint8_t * ) ) 
+{
+    uint8_t first;
+
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer || !source( &first ))
+        return true;
+
+    streamSource = source;
+    if (_startStream( slaveAddress, 0 ))
+        return true;
+
+    // Send the first byte, triggering the TX interrupt
+    streamCount = 1;
+    DWire_clearInterruptFlag( module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0 );
+    DWire_enableInterrupt( module,
+            EUSCI_B_I2C_TRANSMIT_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+    DWire_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+    _started( slaveAddress << 1 );
+    _trace( TRACE_TX, first );
+    DWire_masterSendMultiByteStartWithTimeout( module, first, TIMEOUTLIMIT );
+    DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+    return false;
+}
+
+/**
+ * Start a streaming read of length bytes and return immediately: the ISR
+ * hands every byte to sink. The outcome is reported through onComplete
+ * and transferStatus. It returns false if the transfer was started
+ */
+bool DWire::readStreamAsync( uint_fast8_t slaveAddress, uint32_t length,
+        void (*sink)( uint8_t ) ) 
+{
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer || !length)
+        return true;
+
+    streamSink = sink;
+    streamLength = length;
+    if (_startStream( slaveAddress, length ))
+        return true;
+
+    receiving = true;
+    DWire_clearInterruptFlag( module, EUSCI_B_I2C_RECEIVE_INTERRUPT0 );
+    DWire_enableInterrupt( module,
+            EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+    DWire_setMode( module, EUSCI_B_I2C_RECEIVE_MODE );
+    _started( slaveAddress << 1 | 1 );
+    DWire_masterReceiveStart( module );
+    return false;
+}
+
+/**
+ * Returns the number of bytes moved by the last streaming transfer; on a
+ * NAK, the bytes taken from the source before it
+ */
+uint32_t DWire::streamedBytes( void ) 
+{
+    return streamCount;
+}
+
+/**
+ * Probe the addresses in the set (ADDRESS_WORDS words) with an address-only
+ * write each, START, address and STOP, and record in present whether they
+ * were ACKed. The bits of the other addresses are left as they are. It
+ * returns true if the probes could not be completed
+ */
+bool DWire::probe( const uint32_t * addresses, uint32_t * present ) 
+{
+    if (busRole != BUS_ROLE_MASTER)
+        return true;
+
+    DWIRE_WAIT_TIMER( moduleIndex );
+
+    // Wait for any asynchronous or queued transfer to finish
+    _wait( &DWire::_isAsync );
+
+    blocking = true;
+    bool failed = probeAsync( addresses, present );
+    if (!failed)
+    {
+        _wait( &DWire::_isRunning );
+
+        if (asyncStatus == TRANSFER_PENDING) 
+        {
+            _resetBus( );
+        }
+        failed = asyncStatus != TRANSFER_SUCCESS;
+    }
+    blocking = false;
+    return failed;
+}
+
+/**
+ * Start the probes of probe and return immediately: the ISR sends every
+ * next probe as soon as the previous one has ended. onComplete and
+ * transferCount report the devices found. It returns false if started
+ */
+bool DWire::probeAsync( const uint32_t * addresses, uint32_t * present ) 
+{
+    if (busRole != BUS_ROLE_MASTER || asyncTransfer)
+        return true;
+
+    if (!_awaitStop( )) 
+    {
+        _resetBus( );
+        return true;
+    }
+    _clearByteCounter( );
+
+    probeSet = addresses;
+    probePresent = present;
+    probeAddress = 0;
+    transferBytes = 0;
+    gotNAK = false;
+    receiving = false;
+    _beginAsync( );
+    probing = true;
+    DWire_enableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+    _nextProbe( );
+    return false;
+}
+
+/**
+ * Register the handler called from the ISR when an asynchronous transfer
+ * ends, with its status and the number of bytes transferred
+ */
+void DWire::onComplete( void (*islHandle)( uint8_t, uint8_t ) ) 
+{
+    user_onComplete = islHandle;
+}
+
+/**
+ * Returns the status of the last asynchronous transfer (TRANSFER_...)
+ */
+uint8_t DWire::transferStatus( void ) 
+{
+    return asyncStatus;
+}
+
+/**
+ * Returns the number of bytes of the last asynchronous transfer
+ */
+uint8_t DWire::transferCount( void ) 
+{
+    return asyncCount;
+}
+
+/**
+ * Clear the bus after an asynchronous or queued transfer has timed out,
+ * or, as a slave, call onClockLow after a clock low timeout. The interrupt
+ * handlers only mark these, as the bus clear takes far too long for them
+ * and onClockLow is the user's; they stay pending until then. The
+ * blocking calls of a master do this on their own, a main loop that only
+ * uses the asynchronous ones, or a slave with onClockLow, calls it every
+ * now and then. It returns true if there was anything to handle
+ */
+bool DWire::process( void ) 
+{
+    if (clockLowPending)
+    {
+        clockLowPending = false;
+        if (user_onClockLow)
+        {
+            user_onClockLow( );
+        }
+        return true;
+    }
+
+    if (!recoveryPending)
+        return false;
+
+    _recover( );
+    return true;
+}
+
+/**
+ * Queue a transaction as a master. It is started from the ISR as soon as
+ * the transfers before it have ended, without a trip to the main thread.
+ * It returns true if the queue is full or the transaction is empty
+ */
+bool DWire::queue( DWireTransaction * transaction ) 
+{
+    if (busRole != BUS_ROLE_MASTER || _isQueueFull( ))
+        return true;
+
+    if (transaction->messageCount ?
+            _checkMessages( transaction->messages, transaction->messageCount ) :
+            !transaction->writeLength && !transaction->readLength)
+        return true;
+
+    transaction->status = TRANSFER_PENDING;
+    transaction->count = 0;
+#if DWIRE_LATENCY
+    transaction->queued = DWire_cycles( );
+#endif
+    transactions[queueTail & (TRANSACTION_QUEUE_SIZE - 1)] = transaction;
+
+    // the ISR may just be finishing the last transfer, and the timer
+    // interrupt looks at the one that is started
+    bool disabled = MAP_Interrupt_disableMaster( );
+    queueTail++;
+    _startNext( );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+    return false;
+}
+
+/**
+ * Returns the number of queued transactions that have not completed yet
+ */
+uint8_t DWire::queueLength( void ) 
+{
+    return (uint8_t) (queueTail - queueHead) + (current ? 1 : 0);
+}
+
+/**
+ * Probe the same set of addresses on every module of the group (GROUP_B0
+ * to GROUP_B3) at once, as probe does on one: present[n] receives the
+ * bitmap of eUSCI_Bn. It waits until all of them have ended, so it takes
+ * as long as one scan of the slowest bus. It returns true if a module of
+ * the group is not a master or its probes could not be completed; its
+ * transferStatus tells which
+ */
+bool DWire::probeGroup( uint8_t group, const uint32_t * addresses,
+        uint32_t (*present)[ADDRESS_WORDS] ) 
+{
+    uint8_t masters = _masters( group );
+    bool failed = masters != group;
+
+    // Wait for any asynchronous or queued transfer to finish
+    _waitGroup( masters, &DWire::_isAsync );
+
+    uint8_t started = 0;
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if (!(masters & (1 << m)))
+            continue;
+
+        DWire * instance = DWire_instances[m];
+        instance->blocking = true;
+        if (instance->probeAsync( addresses, present[m] )) 
+        {
+            instance->blocking = false;
+            failed = true;
+        }
+        else
+        {
+            started |= 1 << m;
+        }
+    }
+
+    _waitGroup( started, &DWire::_isRunning );
+
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if (!(started & (1 << m)))
+            continue;
+
+        DWire * instance = DWire_instances[m];
+        if (instance->asyncStatus == TRANSFER_PENDING) 
+        {
+            instance->_resetBus( );
+        }
+        failed |= instance->asyncStatus != TRANSFER_SUCCESS;
+        instance->blocking = false;
+    }
+    return failed;
+}
+
+/**
+ * Queue count transactions, transactions[i] on eUSCI_B modules[i], and
+ * wait until all of them have ended. The transactions of a module run one
+ * after the other from its ISR while the other modules run theirs; one
+ * that does not fit in the queue waits for room. It returns true if any
+ * of them failed or could not be queued, its status tells which
+ */
+bool DWire::transferGroup( DWireTransaction * transactions, const uint8_t * modules,
+        uint8_t count ) 
+{
+    uint8_t group = 0;
+    bool failed = false;
+
+    for (uint8_t i = 0; i < count; i++) 
+    {
+        uint8_t m = modules[i];
+        if (m >= 4 || !_masters( 1 << m )) 
+        {
+            transactions[i].status = TRANSFER_FAILED;
+            failed = true;
+            continue;
+        }
+
+        DWire * instance = DWire_instances[m];
+        _waitGroup( 1 << m, &DWire::_isQueueFull );
+        if (instance->queue( &transactions[i] )) 
+        {
+            transactions[i].status = TRANSFER_FAILED;
+            failed = true;
+            continue;
+        }
+        group |= 1 << m;
+    }
+
+    waitGroup( group );
+
+    for (uint8_t i = 0; i < count; i++) 
+    {
+        failed |= transactions[i].status != TRANSFER_SUCCESS;
+    }
+    return failed;
+}
+
+/**
+ * Wait until the asynchronous and queued transfers of every master of the
+ * group (GROUP_B0 to GROUP_B3) have ended
+ */
+void DWire::waitGroup( uint8_t group ) 
+{
+    _waitGroup( _masters( group ), &DWire::_isAsync );
+}
+
+/**
+ * Returns true if the module is configured as a master
+ */
+bool DWire::isMaster( void ) 
+{
+	return busRole == BUS_ROLE_MASTER;
+}
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * The main initialisation method to setup pins and interrupts
+ */
+void DWire::_initMain( void ) 
+{
+    requestDone = false;
+    sendStop = true;
+
+    DWire_instances[moduleIndex] = this;
+    MAP_I2C_registerInterrupt( module,
+            busRole == BUS_ROLE_MASTER ? masterHandler : slaveHandler );
+
+    // Initialise the receiver buffer and related variables
+    *pTxBufferIndex = 0;
+    *pRxBufferIndex = 0;
+    *pTxBufferSize = 0;
+    *pRxBufferSize = 0;
+    *pTxData = pTxBuffer;
+    *pRxData = pRxBuffer;
+}
+
+/**
+ * The interrupt handler of a role on eUSCI_B<M>, none if the DWire is bound
+ * to the other role, so that the handler is not even compiled
+ */
+template <uint8_t M, uint8_t ROLE, bool BOUND>
+struct DWireHandler
+{
+    static void (*get( void ))( void ) { return DWire_irqHandler<M, ROLE>; }
+};
+
+template <uint8_t M, uint8_t ROLE>
+struct DWireHandler<M, ROLE, false>
+{
+    static void (*get( void ))( void ) { return 0; }
+};
+
+/**
+ * Take the registers, pins, buffers and the interrupt handlers of ROLE
+ * (BUS_ROLE_ANY for both) of eUSCI_B<M>
+ */
+template <uint8_t M, uint8_t ROLE>
+void DWire::_bind( void ) 
+{
+    DWireBuffers & buffers = DWire_buffers[M];
+
+    moduleIndex = M;
+    module = DWireModule<M>::base;
+    intModule = DWireModule<M>::interrupt;
+    modulePort = DWireModule<M>::port;
+    modulePins = DWireModule<M>::pins;
+    moduleSCL = DWireModule<M>::scl;
+    moduleSDA = DWireModule<M>::sda;
+    dmaTxMapping = DWireModule<M>::dmaTx;
+    dmaRxMapping = DWireModule<M>::dmaRx;
+
+    pTxBuffer = buffers.txBuffer;
+    pTxBufferIndex = &buffers.txBufferIndex;
+    pTxBufferSize = &buffers.txBufferSize;
+    pTxData = &buffers.txData;
+
+    pRxBuffer = buffers.rxBuffer;
+    pRxBufferIndex = &buffers.rxBufferIndex;
+    pRxBufferSize = &buffers.rxBufferSize;
+    pRxData = &buffers.rxData;
+
+    masterHandler = DWireHandler<M, BUS_ROLE_MASTER, ROLE != BUS_ROLE_SLAVE>::get( );
+    slaveHandler = DWireHandler<M, BUS_ROLE_SLAVE, ROLE != BUS_ROLE_MASTER>::get( );
+}
+
+/* The bindings of DWireT, per module and role */
+#define DWIRE_BIND( M ) \
+    template void DWire::_bind<M, BUS_ROLE_MASTER>( void ); \
+    template void DWire::_bind<M, BUS_ROLE_SLAVE>( void ); \
+    template void DWire::_bind<M, BUS_ROLE_ANY>( void );
+
+DWIRE_BIND( 0 )
+DWIRE_BIND( 1 )
+DWIRE_BIND( 2 )
+DWIRE_BIND( 3 )
+
+/**
+ * Called to set the eUSCI module in 'master' mode
+ */
+void DWire::_initMaster( const eUSCI_I2C_MasterConfig * i2cConfig ) 
+{
+    // Initialise the pins
+    MAP_GPIO_setAsPeripheralModuleFunctionInputPin( modulePort, modulePins,
+    GPIO_PRIMARY_MODULE_FUNCTION );
+
+    // Initializing I2C Master to SMCLK with no autostop
+    MAP_I2C_initMaster( module, i2cConfig );
+
+    // Specify slave address
+    MAP_I2C_setSlaveAddress( module, slaveAddress );
+
+    // Set Master in transmit mode
+    MAP_I2C_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+
+    // Enable I2C Module to start operations
+    MAP_I2C_enableModule( module );
+
+    // Clear the interrupt flag
+    MAP_I2C_clearInterruptFlag( module,
+            EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT
+                    + EUSCI_B_I2C_RECEIVE_INTERRUPT0 );
+
+    // Register the interrupts on the correct module
+    MAP_Interrupt_enableInterrupt( intModule );
+    MAP_Interrupt_enableMaster( );
+}
+
+void DWire::_initSlave( void ) 
+{
+    // Init the pins
+    MAP_GPIO_setAsPeripheralModuleFunctionInputPin( modulePort, modulePins,
+    GPIO_PRIMARY_MODULE_FUNCTION );
+
+    // initialise driverlib with the own addresses, the unused ones disabled
+    static const uint_fast8_t offsets[OWN_ADDRESSES] = { EUSCI_B_I2C_OWN_ADDRESS_OFFSET0,
+            EUSCI_B_I2C_OWN_ADDRESS_OFFSET1, EUSCI_B_I2C_OWN_ADDRESS_OFFSET2,
+            EUSCI_B_I2C_OWN_ADDRESS_OFFSET3 };
+    for (uint8_t n = 0; n < OWN_ADDRESSES; n++)
+    {
+        MAP_I2C_initSlave( module, ownAddresses[n], offsets[n],
+                n < ownAddressCount ? EUSCI_B_I2C_OWN_ADDRESS_ENABLE
+                        : EUSCI_B_I2C_OWN_ADDRESS_DISABLE );
+    }
+
+    // Enable the module and enable interrupts; the flags are cleared while
+    // it is still in reset, those of a frame that comes in right away stay
+    uint_fast16_t interrupts = _slaveInterrupts( );
+    MAP_I2C_clearInterruptFlag( module, interrupts );
+    MAP_I2C_enableModule( module );
+    MAP_I2C_enableInterrupt( module, interrupts );
+
+    /* Enable the clock low timeout */
+    EUSCI_B_CMSIS( module )->CTLW1 = (EUSCI_B_CMSIS( module )->CTLW1
+            & ~EUSCI_B_CTLW1_CLTO_MASK) | 0xC0;
+
+    MAP_Interrupt_enableInterrupt( intModule );
+    MAP_Interrupt_enableMaster( );
+}
+
+/**
+ * The interrupts of the module as a slave
+ */
+uint_fast16_t DWire::_slaveInterrupts( void ) 
+{
+    uint_fast16_t interrupts = EUSCI_B_I2C_STOP_INTERRUPT
+            | EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT;
+    bool banks = false;
+    for (uint8_t n = 0; n < ownAddressCount; n++)
+    {
+        interrupts |= DWire_addressFlags[n];
+        banks = banks || DWire_banks[moduleIndex][n].registers;
+    }
+
+    // the START ends a frame of a register bank, of the frame ring or of
+    // a staged response, and shows up in the trace
+    if (DWIRE_TRACE || banks || DWire_frames[moduleIndex].ring
+            || DWire_responses[moduleIndex].published)
+    {
+        interrupts |= EUSCI_B_I2C_START_INTERRUPT;
+    }
+    return interrupts;
+}
+
+/**
+ * Send the START for the tx buffer's contents as a master.
+ * It returns true if the bus did not become available
+ */
+bool DWire::_startTransmission( bool sendStop ) 
+{
+    // Wait until any ongoing (incoming) transmissions are finished
+    if (!_awaitStop( )) 
+    {
+        /* If we can't start the transmission, then reset everything */
+        _resetBus( );
+        return true;
+    }
+
+    this->sendStop = sendStop;
+    gotNAK = false;
+    receiving = false;
+
+    // Send the start condition and initial byte
+    (*pTxBufferSize) = *pTxBufferIndex;
+    transferBytes = *pTxBufferSize;
+
+    // The DMA needs the byte counter to generate the STOP, which can
+    // only be programmed while the bus is idle
+    if (dmaEnabled && sendStop && !byteCounterArmed
+            && DWire_isBusBusy( module ) == EUSCI_B_I2C_BUS_NOT_BUSY)
+    {
+        _setByteCounter( *pTxBufferSize,
+                EUSCI_B_I2C_SEND_STOP_AUTOMATICALLY_ON_BYTECOUNT_THRESHOLD );
+        _startDMA( dmaTxMapping, UDMA_SRC_INC_8 | UDMA_DST_INC_NONE, *pTxData,
+                (void *) &EUSCI_B_CMSIS( module )->TXBUF, *pTxBufferSize );
+        DWIRE_COUNT( moduleIndex, bytesTx, *pTxBufferSize );
+
+        DWire_clearInterruptFlag( module,
+        EUSCI_B_I2C_STOP_INTERRUPT + EUSCI_B_I2C_NAK_INTERRUPT );
+        DWire_enableInterrupt( module,
+        EUSCI_B_I2C_STOP_INTERRUPT + EUSCI_B_I2C_NAK_INTERRUPT );
+
+        // The START raises TXIFG, which lets the DMA load the first byte
+        DWire_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+        _started( slaveAddress << 1 );
+        DWire_masterSendStart( module );
+    }
+    else
+    {
+        if (!byteCounterArmed)
+        {
+            _clearByteCounter( );
+        }
+
+        // Clear the interrupt flags and enable
+        DWire_clearInterruptFlag( module,
+        EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT );
+
+        DWire_enableInterrupt( module,
+        EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT );
+
+        // Set the master into transmit mode
+        DWire_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+
+        // Send the first byte, triggering the TX interrupt
+        _started( slaveAddress << 1 );
+        _trace( TRACE_TX, (*pTxData)[0] );
+        DWire_masterSendMultiByteStartWithTimeout( module, (*pTxData)[0],
+        TIMEOUTLIMIT );
+        DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+    }
+    return false;
+}
+
+/**
+ * Set up the byte counter for a request of numBytes, and decide whether
+ * it can be moved by the DMA.
+ * The ISR requests the STOP of a read while its last byte comes in, once
+ * it has seen the byte before; the eUSCI only raises RXIFG for a byte
+ * once it has been received, and none at the end of the address. A single
+ * byte read is therefore ended by the byte counter, which is only possible
+ * on an idle bus, without a write before it. Otherwise it takes two bytes
+ * on the bus, and the second one is dropped (see rxDrop)
+ */
+bool DWire::_prepareRequest( uint_fast8_t numBytes ) 
+{
+    // A DMA read and a single byte need the byte counter to end exactly;
+    // the ISR ends any other read in time. The counter restarts on the
+    // repeated START, so it must not trigger while pending bytes are sent.
+    _prepareCounter( numBytes > *pTxBufferIndex && (dmaEnabled || numBytes == 1),
+            numBytes );
+    return dmaEnabled && counterStop;
+}
+
+/**
+ * Have the hardware generate the STOP after a read of numBytes, if
+ * possible; the byte counter can only be programmed while the bus is
+ * idle. Otherwise the ISR requests the STOP
+ */
+void DWire::_prepareCounter( bool possible, uint8_t numBytes ) 
+{
+    counterStop = possible && DWire_isBusBusy( module ) == EUSCI_B_I2C_BUS_NOT_BUSY;
+    if (counterStop)
+    {
+        _setByteCounter( numBytes,
+                EUSCI_B_I2C_SEND_STOP_AUTOMATICALLY_ON_BYTECOUNT_THRESHOLD );
+    }
+    else
+    {
+        _clearByteCounter( );
+    }
+}
+
+/**
+ * Wait until a STOP has been sent. It returns false if it was not
+ */
+bool DWire::_awaitStop( void ) 
+{
+    uint32_t wait = TIMEOUTLIMIT;
+    while (DWire_masterIsStopSent( module ) == EUSCI_B_I2C_SENDING_STOP && wait)
+        wait--;
+
+    return wait;
+}
+
+/**
+ * Send the (repeated) START of a request; the ISR or the DMA fills the
+ * rx buffer. Also called from the ISR to continue an asynchronous request
+ */
+void DWire::_startRequest( uint_fast8_t slaveAddress, uint_fast8_t numBytes, bool dma ) 
+{
+    // Re-initialise the rx buffer
+    *pRxBufferSize = numBytes;
+    *pRxBufferIndex = 0;
+    DWire_buffers[moduleIndex].rxDrop = numBytes == 1 && !counterStop;
+    transferBytes = numBytes;
+
+    // Configure the correct slave
+    DWire_setSlaveAddress( module, slaveAddress );
+    this->slaveAddress = slaveAddress;
+
+    uint_fast16_t interrupts;
+    if (dma)
+    {
+        _startDMA( dmaRxMapping, UDMA_SRC_INC_NONE | UDMA_DST_INC_8,
+                (void *) &EUSCI_B_CMSIS( module )->RXBUF, *pRxData, numBytes );
+        DWIRE_COUNT( moduleIndex, bytesRx, numBytes );
+        interrupts = EUSCI_B_I2C_STOP_INTERRUPT | EUSCI_B_I2C_NAK_INTERRUPT;
+    }
+    else
+    {
+        // asynchronous requests complete on the STOP, so that the next
+        // transfer can be started right away
+        interrupts = EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT
+                | (asyncTransfer ? EUSCI_B_I2C_STOP_INTERRUPT : 0);
+    }
+
+    DWire_clearInterruptFlag( module, interrupts );
+    DWire_enableInterrupt( module, interrupts );
+
+    // Set the master into receive mode
+    DWire_setMode( module, EUSCI_B_I2C_RECEIVE_MODE );
+
+    // Initialize the flag showing the status of the request
+    requestDone = false;
+    gotNAK = false;
+    receiving = true;
+
+    // Send the START
+    _started( slaveAddress << 1 | 1 );
+    DWire_masterReceiveStart( module );
+}
+
+/**
+ * Mark the start of an asynchronous transfer
+ */
+void DWire::_beginAsync( void ) 
+{
+    asyncStatus = TRANSFER_PENDING;
+    asyncCount = 0;
+    asyncTransfer = true;
+    _startTimeout( );
+}
+
+/**
+ * Set up the Timer32 of the timeouts, once for all instances, and convert
+ * the timeout into its ticks
+ */
+void DWire::_initTimeout( void ) 
+{
+    if (!DWire_timerReady)
+    {
+        MAP_Timer32_initModule( DWIRE_TIMER, TIMER32_PRESCALER_16, TIMER32_32BIT,
+                TIMER32_FREE_RUN_MODE );
+        MAP_Timer32_registerInterrupt( DWIRE_TIMER_INTERRUPT, DWire_timerHandler );
+        MAP_Timer32_enableInterrupt( DWIRE_TIMER );
+        DWire_timerReady = true;
+    }
+
+    // deadlines are compared as signed differences
+    uint64_t ticks = (uint64_t) timeoutMicros * (MAP_CS_getMCLK( ) / 16) / 1000000;
+    if (ticks > 0x7FFFFFFF)
+    {
+        ticks = 0x7FFFFFFF;
+    }
+    timeoutTicks = timeoutMicros && !ticks ? 1 : (uint32_t) ticks;
+}
+
+/**
+ * Wait while the condition holds, clearing the bus after an asynchronous
+ * transfer that has timed out meanwhile. Polling, the deadline is checked
+ * here as well, so that the wait ends on time even while the timer
+ * interrupt is held off. With low power enabled, the condition is checked
+ * with interrupts disabled: an interrupt that comes in after the check
+ * stays pending and ends the sleep right away, to be taken once they are
+ * enabled again
+ */
+void DWire::_wait( bool (DWire::*busy)( void ) ) 
+{
+    if (!lowPower)
+    {
+        while ((this->*busy)( ))
+        {
+            _pollTimeout( );
+            _recover( );
+        }
+        _traceTimeout( );
+        return;
+    }
+
+    bool disabled = MAP_Interrupt_disableMaster( );
+    while ((this->*busy)( ))
+    {
+        MAP_PCM_gotoLPM0( );
+        MAP_Interrupt_enableMaster( );
+        _recover( );
+        MAP_Interrupt_disableMaster( );
+    }
+
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+    _traceTimeout( );
+}
+
+/**
+ * Returns the modules of the group that have a DWire master
+ */
+uint8_t DWire::_masters( uint8_t group ) 
+{
+    uint8_t masters = 0;
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if ((group & (1 << m)) && DWire_instances[m]
+                && DWire_instances[m]->busRole == BUS_ROLE_MASTER)
+        {
+            masters |= 1 << m;
+        }
+    }
+    return masters;
+}
+
+/**
+ * Wait while the condition holds for any module of the group, as _wait
+ * does for one. The CPU only sleeps if all of them have low power enabled,
+ * and the time is added to the waitTime of each of them
+ */
+void DWire::_waitGroup( uint8_t group, bool (DWire::*busy)( void ) ) 
+{
+    bool lowPower = group != 0;
+#if DWIRE_STATISTICS
+    uint32_t start = DWire_time( );
+#endif
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if (group & (1 << m))
+            lowPower = lowPower && DWire_instances[m]->lowPower;
+    }
+
+    bool disabled = lowPower && MAP_Interrupt_disableMaster( );
+    for (;;) 
+    {
+        bool waiting = false;
+        for (uint8_t m = 0; m < 4 && !waiting; m++) 
+        {
+            waiting = (group & (1 << m)) && (DWire_instances[m]->*busy)( );
+        }
+        if (!waiting)
+            break;
+
+        if (lowPower) 
+        {
+            MAP_PCM_gotoLPM0( );
+            MAP_Interrupt_enableMaster( );
+        }
+        for (uint8_t m = 0; m < 4; m++) 
+        {
+            if (!(group & (1 << m)))
+                continue;
+
+            if (!lowPower)
+            {
+                DWire_instances[m]->_pollTimeout( );
+            }
+            DWire_instances[m]->_recover( );
+        }
+        if (lowPower) 
+        {
+            MAP_Interrupt_disableMaster( );
+        }
+    }
+
+    if (lowPower && !disabled) 
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if (group & (1 << m))
+            DWire_instances[m]->_traceTimeout( );
+    }
+
+#if DWIRE_STATISTICS
+    uint32_t elapsed = DWire_time( ) - start;
+    for (uint8_t m = 0; m < 4; m++) 
+    {
+        if (group & (1 << m))
+            DWIRE_COUNT( m, waitTime, elapsed );
+    }
+#endif
+}
+
+/**
+ * Clear the bus after the timeout of an asynchronous transfer, which the
+ * timer interrupt has only marked, and go on with the queue. Called from
+ * the main thread
+ */
+void DWire::_recover( void ) 
+{
+    _traceTimeout( );
+    if (!recoveryPending)
+        return;
+
+    recoveryPending = false;
+    _resetBus( );
+
+    bool disabled = MAP_Interrupt_disableMaster( );
+    _startNext( );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+}
+
+/**
+ * Check the deadline of the transfer from a polling wait, as the timer
+ * interrupt does. It may be held off, by a caller with a higher priority
+ * or with interrupts disabled; on the host, polling memory does not let
+ * the simulated time pass either
+ */
+void DWire::_pollTimeout( void ) 
+{
+    if (!watching || (int32_t) (DWire_now( ) - deadline) < 0)
+        return;
+
+    bool disabled = MAP_Interrupt_disableMaster( );
+    if (watching)
+    {
+        _checkTimeout( DWire_now( ) );
+    }
+
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+}
+
+/**
+ * Start the timeout of a transfer: the timer interrupt sets expired once
+ * it has not moved on for timeoutTicks. Every master transfer starts here
+ */
+void DWire::_startTimeout( void ) 
+{
+    _traceTimeout( );
+    DWIRE_COUNT( moduleIndex, transactions, 1 );
+#if DWIRE_LATENCY
+    latencyPoints[0] = DWire_cycles( );
+    latencySeen = 1;
+#endif
+    expired = false;
+    watching = false;
+    if (!timeoutTicks)
+        return;
+
+    deadline = DWire_now( ) + timeoutTicks;
+    progress = _progress( );
+    watching = true;
+
+    // the timer only has to be moved if it runs beyond the deadline, which
+    // the timer interrupt may have taken care of in the meantime
+    if (!DWire_timerRunning || (int32_t) (DWire_timerEnd - deadline) > 0)
+    {
+        bool disabled = MAP_Interrupt_disableMaster( );
+        if (!DWire_timerRunning || (int32_t) (DWire_timerEnd - deadline) > 0)
+        {
+            int32_t left = (int32_t) (deadline - DWire_now( ));
+            DWire_runTimer( left > 0 ? left : 1 );
+        }
+
+        if (!disabled)
+        {
+            MAP_Interrupt_enableMaster( );
+        }
+    }
+}
+
+/**
+ * A value that changes whenever a transfer moves on: the byte count of
+ * the eUSCI (which also follows the DMA), the buffer indexes, the
+ * messages left, the bytes streamed and the addresses probed
+ */
+uint32_t DWire::_progress( void ) 
+{
+    return streamCount + probeAddress
+            + ((EUSCI_B_CMSIS( module )->STATW & EUSCI_B_STATW_BCNT_MASK)
+            | *pTxBufferIndex | (uint32_t) *pRxBufferIndex << 16
+            | (uint32_t) messagesLeft << 24);
+}
+
+/**
+ * Called from the timer interrupt: abandon the transfer if it has not
+ * moved on by its deadline. Returns the ticks left until the deadline,
+ * 0 if there is none
+ */
+uint32_t DWire::_checkTimeout( uint32_t now ) 
+{
+    if (!watching)
+        return 0;
+
+    int32_t left = (int32_t) (deadline - now);
+    if (left > 0)
+        return left;
+
+    // a transfer that is still moving on gets another period
+    uint32_t moved = _progress( );
+    if (moved != progress)
+    {
+        progress = moved;
+        deadline = now + timeoutTicks;
+        return timeoutTicks;
+    }
+
+    watching = false;
+    expired = true;
+    DWIRE_COUNT( moduleIndex, timeouts, 1 );
+#if DWIRE_TRACE
+    // the timer interrupt is not the trace ring's writer (see _traceTimeout)
+    timeoutCycles = DWire_cycles( );
+    timeoutTracePending = true;
+#endif
+
+    // a blocking call resets the bus itself; for the others it is done
+    // outside of the interrupt (see process)
+    if (asyncTransfer && !blocking)
+    {
+        recoveryPending = true;
+    }
+    return 0;
+}
+
+/**
+ * Add an event to the trace ring from outside of the interrupt handler
+ * of the module (or from code it shares with the main thread)
+ */
+void DWire::_trace( uint8_t type, uint8_t data ) 
+{
+#if DWIRE_TRACE
+    bool disabled = MAP_Interrupt_disableMaster( );
+    DWire_trace( moduleIndex, type, data, DWire_cycles( ) );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+#else
+    (void) type;
+    (void) data;
+#endif
+}
+
+/**
+ * Add the last timeout to the trace ring, at the time the timer interrupt
+ * found it. Called from the main thread, which sees it end the wait
+ */
+void DWire::_traceTimeout( void ) 
+{
+#if DWIRE_TRACE
+    if (!timeoutTracePending)
+        return;
+
+    bool disabled = MAP_Interrupt_disableMaster( );
+    timeoutTracePending = false;
+    DWire_trace( moduleIndex, TRACE_TIMEOUT, 0, timeoutCycles );
+    if (!disabled)
+    {
+        MAP_Interrupt_enableMaster( );
+    }
+#endif
+}
+
+/**
+ * Called when a START is sent as a master: trace it and note the time of
+ * the first one of the transaction
+ */
+void DWire::_started( uint8_t addressRW ) 
+{
+    _trace( TRACE_START, addressRW );
+    // the eUSCI only finds out while it sends the address; the flag is
+    // cleared by the handler, with the reset of _arbitrationLost
+    DWire_enableInterrupt( module, EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT );
+#if DWIRE_LATENCY
+    if (!(latencySeen & (1 << 1)))
+    {
+        latencyPoints[1] = DWire_cycles( );
+        latencySeen |= 1 << 1;
+    }
+#endif
+}
+
+/**
+ * Called from the ISR for every byte as a master
+ */
+void DWire::_markByte( void ) 
+{
+#if DWIRE_LATENCY
+    uint32_t now = DWire_cycles( );
+    if (!(latencySeen & (1 << 2)))
+    {
+        latencyPoints[2] = now;
+    }
+    latencyPoints[3] = now;
+    latencySeen |= (1 << 2) | (1 << 3);
+#endif
+}
+
+/**
+ * Add the phases of a transaction that has just ended to the histograms
+ * of its device
+ */
+void DWire::_recordLatency( bool success ) 
+{
+#if DWIRE_LATENCY
+    uint32_t now = DWire_cycles( );
+    uint8_t seen = latencySeen;
+    latencySeen = 0;
+    if (!success || !(seen & 1))
+        return;
+
+    DWireLatency * device = DWire_findLatency( moduleIndex, slaveAddress, true );
+    if (!device)
+        return;
+
+    // a phase needs the points on both ends
+    for (uint8_t phase = LATENCY_QUEUED; phase <= LATENCY_STOP; phase++)
+    {
+        bool last = phase == LATENCY_STOP;
+        if ((seen & (1 << phase)) && (last || (seen & (2 << phase))))
+        {
+            uint32_t end = last ? now : latencyPoints[phase + 1];
+            DWire_addSample( device->histogram[phase], end - latencyPoints[phase] );
+        }
+    }
+    DWire_addSample( device->histogram[LATENCY_TOTAL], now - latencyPoints[0] );
+    device->transactions++;
+#else
+    (void) success;
+#endif
+}
+
+/**
+ * Set up or remove the register bank of own address n
+ */
+void DWire::_registerBank( uint8_t n, uint8_t * registers, uint16_t size,
+        const uint8_t * writable ) 
+{
+    DWireBank & bank = DWire_banks[moduleIndex][n];
+    void (*onWrite)( uint8_t, uint8_t ) = bank.onWrite;
+
+    bool enabled = MAP_Interrupt_isEnabled( intModule );
+    MAP_Interrupt_disableInterrupt( intModule );
+    memset( &bank, 0, sizeof(DWireBank) );
+    bank.onWrite = onWrite;
+    if (registers && size)
+    {
+        bank.writable = writable;
+        bank.size = size > 256 ? 256 : size;
+        bank.registers = registers;
+    }
+    if (enabled)
+    {
+        MAP_Interrupt_enableInterrupt( intModule );
+    }
+
+    // a repeated START has to end a frame as well
+    if (bank.registers && busRole == BUS_ROLE_SLAVE)
+    {
+        MAP_I2C_enableInterrupt( module, EUSCI_B_I2C_START_INTERRUPT );
+    }
+}
+
+/**
+ * Returns the index of one of the own addresses as a slave, -1 if address
+ * is not one of them
+ */
+int8_t DWire::_ownAddress( uint8_t address ) 
+{
+    for (uint8_t n = 0; n < ownAddressCount; n++)
+    {
+        if (ownAddresses[n] == address)
+            return n;
+    }
+    return -1;
+}
+
+/**
+ * Re-set the slave address (the target address when master or the slave's address when slave)
+ */
+void DWire::_setSlaveAddress( uint_fast8_t newAddress ) 
+{
+    slaveAddress = newAddress;
+    DWire_setSlaveAddress( module, newAddress );
+}
+
+/**
+ * Claim the eUSCI TX0/RX0 DMA channels of this module. Without a control
+ * table (see DWIRE_DMA_TABLE) the transfers stay with the ISR
+ */
+void DWire::_initDMA( void ) 
+{
+    if (!MAP_DMA_getControlBase( ))
+    {
+        dmaEnabled = false;
+        return;
+    }
+
+    MAP_DMA_enableModule( );
+
+    MAP_DMA_assignChannel( dmaTxMapping );
+    MAP_DMA_assignChannel( dmaRxMapping );
+    MAP_DMA_disableChannelAttribute( DMACHANNEL( dmaTxMapping ), UDMA_ATTR_ALL );
+    MAP_DMA_disableChannelAttribute( DMACHANNEL( dmaRxMapping ), UDMA_ATTR_ALL );
+}
+
+/**
+ * Arm a DMA channel for a basic transfer of single bytes
+ */
+void DWire::_startDMA( uint32_t mapping, uint32_t increments, void * source,
+        void * destination, uint8_t numBytes ) 
+{
+    uint32_t channel = DMACHANNEL( mapping );
+
+    MAP_DMA_setChannelControl( UDMA_PRI_SELECT | channel,
+            UDMA_SIZE_8 | increments | UDMA_ARB_1 );
+    MAP_DMA_setChannelTransfer( UDMA_PRI_SELECT | channel, UDMA_MODE_BASIC,
+            source, destination, numBytes );
+    MAP_DMA_enableChannel( channel );
+}
+
+/**
+ * Program the hardware byte counter and the automatic STOP generation.
+ * The eUSCI has to be held in reset for this, so the bus must be idle.
+ */
+void DWire::_setByteCounter( uint8_t count, uint_fast16_t stopMode ) 
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( module );
+
+    regs->CTLW0 |= EUSCI_B_CTLW0_SWRST;
+    regs->TBCNT = count;
+    regs->CTLW1 = (regs->CTLW1 & ~EUSCI_B_CTLW1_ASTP_MASK) | stopMode;
+    regs->CTLW0 &= ~EUSCI_B_CTLW0_SWRST;
+
+    autoStop = stopMode != EUSCI_B_I2C_NO_AUTO_STOP;
+
+    // the reset has cleared the byte count of the eUSCI, which is not
+    // progress of the transfer about to start (see _checkTimeout)
+    if (watching)
+    {
+        progress = _progress( );
+    }
+}
+
+/**
+ * Make sure a transfer driven by the interrupt handler is not cut short
+ * by a byte counter left over from a DMA transfer
+ */
+void DWire::_clearByteCounter( void ) 
+{
+    if (autoStop && DWire_isBusBusy( module ) == EUSCI_B_I2C_BUS_NOT_BUSY)
+    {
+        _setByteCounter( 0, EUSCI_B_I2C_NO_AUTO_STOP );
+    }
+}
+
+/**
+ * Handle a request ISL as a slave
+ */
+void DWire::_handleRequestSlave( void ) 
+{
+    // Check whether a user interrupt has been set for the address
+    void (*user_onRequest)( void ) = this->user_onRequest[DWire_matched[moduleIndex]];
+    if ( !user_onRequest )
+        return;
+
+    // If no message has been set, then call the user interrupt to set
+    if (!(*pTxBufferIndex)) 
+    {
+        user_onRequest( );
+        DWIRE_TRACE_EVENT( moduleIndex, TRACE_REQUEST, *pTxBufferIndex );
+
+        *pTxBufferSize = *pTxBufferIndex - 1;
+        *pTxBufferIndex = 0;
+    }
+
+    // If we've transmitted the entire message, then reset the tx buffer
+    if (*pTxBufferIndex > *pTxBufferSize) 
+    {
+        DWIRE_TRACE_EVENT( moduleIndex, TRACE_REPLIED, *pTxBufferIndex );
+        *pTxBufferIndex = 0;
+        *pTxBufferSize = 0;
+    } 
+    else 
+    {
+        // Transmit a byte
+        DWire_slavePutData( module, pTxBuffer[*pTxBufferIndex] );
+        DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+        DWIRE_TRACE_EVENT( moduleIndex, TRACE_TX, pTxBuffer[*pTxBufferIndex] );
+        (*pTxBufferIndex)++;
+    }
+}
+
+/**
+ * Called from the ISR on a clock low timeout: drop the frame in flight and
+ * reset the module, which lets go of the bus, unless a hard reset of the
+ * microcontroller was asked for. The module keeps its own addresses while
+ * in reset and goes on as a slave right away; onClockLow is left to
+ * process( ), outside of the interrupt
+ */
+void DWire::_handleClockLow( void ) 
+{
+    if (clockLowPolicy == CLOCK_LOW_HARD_RESET)
+    {
+        MAP_ResetCtl_initiateHardReset( );
+        return;
+    }
+
+    MAP_I2C_disableModule( module );
+    *pTxBufferIndex = 0;
+    *pTxBufferSize = 0;
+    *pRxBufferIndex = 0;
+    *pRxBufferSize = 0;
+    DWire_buffers[moduleIndex].rxFrame = false;
+    DWireBank & bank = DWire_banks[moduleIndex][DWire_matched[moduleIndex]];
+    if (bank.registers)
+    {
+        DWire_bankEnd( bank );
+    }
+    // the frame cut off, if any, is lost
+    DWireFrames & frames = DWire_frames[moduleIndex];
+    if (frames.ring)
+    {
+        frames.dropping = frames.dropping || frames.fill != frames.head;
+        DWire_frameEnd( moduleIndex );
+    }
+    DWire_responses[moduleIndex].sending = 0;
+
+    // the reset has cleared the interrupt enables
+    MAP_I2C_enableModule( module );
+    MAP_I2C_enableInterrupt( module, _slaveInterrupts( ) );
+    clockLowPending = true;
+}
+
+/**
+ * Internal process handling the rx buffers, and calling the user's interrupt handles
+ */
+void DWire::_handleReceive( void ) 
+{
+    DWIRE_TRACE_EVENT( moduleIndex, TRACE_RECEIVE, *pRxBufferIndex );
+
+    // the frame received so far is what read( ) returns, and the next one
+    // starts at the beginning of the buffer
+    DWire_buffers[moduleIndex].rxFrame = false;
+    *pRxBufferSize = *pRxBufferIndex;
+    *pRxBufferIndex = 0;
+
+    // No need to do anything if there is no handler registered for the address
+    void (*user_onReceive)( uint8_t ) = this->user_onReceive[DWire_matched[moduleIndex]];
+    if (!user_onReceive)
+        return;
+
+	// call the user-defined receive handler
+    user_onReceive( *pRxBufferSize );
+}
+
+void DWire::_finishRequest( bool success ) 
+{
+	// reset the RX buffer index to prepare the readout
+	*pRxBufferIndex = 0;
+	_finishTransfer( success );
+}
+
+/**
+ * Report the end of a transfer to the main thread, or to the user when
+ * it was started asynchronously
+ */
+void DWire::_finishTransfer( bool success ) 
+{
+	// mark the transaction as failed
+    gotNAK = !success;
+    watching = false;
+    _trace( TRACE_DONE, success );
+    _recordLatency( success );
+
+    // after a NAK the eUSCI holds the bus until it is told to send a STOP,
+    // which it takes right away; the next START waits for it to be out
+    if (!success)
+    {
+        DWire_masterReceiveMultiByteStop( module );
+    }
+
+    // unlock the main thread
+    requestDone = true;
+
+    if (!asyncTransfer)
+        return;
+
+    if (!success)
+    {
+        // complete once the STOP is out
+        DWire_clearInterruptFlag( module, EUSCI_B_I2C_STOP_INTERRUPT );
+        DWire_enableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+        return;
+    }
+    _completeAsync( TRANSFER_SUCCESS );
+    _startNext( );
+}
+
+/**
+ * Called from the ISR when the arbitration was lost: the eUSCI has cleared
+ * UCMST, and the transfer ends as a failed one without a STOP of its own
+ */
+void DWire::_arbitrationLost( void ) 
+{
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( module );
+
+    // back to master for the next START; the reset clears the interrupt enables
+    regs->CTLW0 |= EUSCI_B_CTLW0_SWRST;
+    regs->CTLW0 |= EUSCI_B_CTLW0_MST;
+    regs->CTLW0 &= ~EUSCI_B_CTLW0_SWRST;
+
+    *pRxBufferIndex = 0;
+    readPending = false;
+    gotNAK = true;
+    watching = false;
+    _trace( TRACE_DONE, 0 );
+    _recordLatency( false );
+
+    // unlock the main thread
+    requestDone = true;
+
+    if (asyncTransfer)
+    {
+        _completeAsync( TRANSFER_FAILED );
+        _startNext( );
+    }
+}
+
+/**
+ * Record the outcome of an asynchronous or queued transfer and notify
+ * the user
+ */
+void DWire::_completeAsync( uint8_t status ) 
+{
+    asyncTransfer = false;
+    readPending = false;
+    watching = false;
+    probing = false;
+    firstPending = false;
+    if (streaming)
+    {
+        streaming = false;
+        // see streamedBytes for the full count
+        transferBytes = streamCount > 0xFF ? 0xFF : streamCount;
+    }
+    asyncCount = status == TRANSFER_SUCCESS ? transferBytes : 0;
+    asyncStatus = status;
+
+    DWireTransaction * transaction = current;
+    if (transaction || message)
+    {
+        // hand the buffers back to the caller
+        current = 0;
+        message = 0;
+        *pTxData = pTxBuffer;
+        *pRxData = pRxBuffer;
+        *pRxBufferSize = 0;
+    }
+
+    if (transaction)
+    {
+        transaction->count = asyncCount;
+        transaction->status = status;
+        if (transaction->onComplete)
+        {
+            transaction->onComplete( transaction );
+        }
+    }
+    else if (user_onComplete && !blocking)
+    {
+        user_onComplete( asyncStatus, asyncCount );
+    }
+}
+
+/**
+ * Start queued transactions until one is in progress or the queue is
+ * empty; called from the ISR when a transfer has ended
+ */
+void DWire::_startNext( void ) 
+{
+    while (!asyncTransfer && queueHead != queueTail)
+    {
+        DWireTransaction * transaction =
+                transactions[queueHead & (TRANSACTION_QUEUE_SIZE - 1)];
+        queueHead++;
+        _startTransaction( transaction );
+    }
+}
+
+/**
+ * Start a queued transaction, with the data moved straight from and to
+ * the caller's buffers
+ */
+void DWire::_startTransaction( DWireTransaction * transaction ) 
+{
+    current = transaction;
+    _beginAsync( );
+#if DWIRE_LATENCY
+    latencyPoints[0] = transaction->queued;
+#endif
+
+    if (transaction->messageCount)
+    {
+        _startMessages( transaction->messages, transaction->messageCount );
+        return;
+    }
+
+    if (transaction->address != slaveAddress)
+    {
+        _setSlaveAddress( transaction->address );
+    }
+    *pTxData = (uint8_t *) transaction->writeData;
+    *pRxData = transaction->readData;
+    *pTxBufferIndex = transaction->writeLength;
+
+    if (!transaction->readLength)
+    {
+        _startTransmission( true );
+        return;
+    }
+
+    bool dma = _prepareRequest( transaction->readLength );
+    if (transaction->writeLength)
+    {
+        // the ISR starts the read after the last byte
+        readAddress = transaction->address;
+        readBytes = transaction->readLength;
+        readDMA = dma;
+        readPending = true;
+
+        byteCounterArmed = counterStop;
+        _startTransmission( false );
+        byteCounterArmed = false;
+        return;
+    }
+
+    if (!_awaitStop( )) 
+    {
+        _resetBus( );
+        return;
+    }
+    _startRequest( transaction->address, transaction->readLength, dma );
+}
+
+/**
+ * Prepare a streaming transfer, which completes on the STOP.
+ * It returns true if the bus did not become available
+ */
+bool DWire::_startStream( uint_fast8_t slaveAddress, uint32_t readLength ) 
+{
+    if (!_awaitStop( )) 
+    {
+        _resetBus( );
+        return true;
+    }
+
+    // the byte counter ends a single byte read; otherwise the data is
+    // moved by the ISR, whatever the byte counter says
+    _prepareCounter( readLength == 1, 1 );
+
+    streamCount = 0;
+    _beginAsync( );
+    streaming = true;
+    gotNAK = false;
+    receiving = false;
+    *pRxBufferSize = 0;
+
+    if (slaveAddress != this->slaveAddress)
+    {
+        _setSlaveAddress( slaveAddress );
+    }
+
+    DWire_clearInterruptFlag( module,
+            EUSCI_B_I2C_NAK_INTERRUPT | EUSCI_B_I2C_STOP_INTERRUPT );
+    DWire_enableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+    return false;
+}
+
+/**
+ * Check a list of messages: none may be empty, and only a write to the
+ * same slave can follow a write without a START. Returns true if invalid
+ */
+bool DWire::_checkMessages( const DWireMessage * messages, uint8_t count ) 
+{
+    if (!count)
+        return true;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!messages[i].length)
+            return true;
+
+        if ((messages[i].flags & MESSAGE_NOSTART)
+                && (!i || (messages[i].flags & MESSAGE_READ)
+                        || (messages[i - 1].flags & MESSAGE_READ)
+                        || messages[i - 1].address != messages[i].address))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Start the first message of a combined transfer; the ISR continues with
+ * the others. It returns true if the bus did not become available
+ */
+bool DWire::_startMessages( DWireMessage * messages, uint8_t count ) 
+{
+    if (!_awaitStop( )) 
+    {
+        _resetBus( );
+        return true;
+    }
+
+    // a single byte read on its own is ended by the byte counter; otherwise
+    // the data is moved by the ISR, and a byte counter left over from a
+    // DMA transfer would end the transfer after the first message
+    _prepareCounter( count == 1 && (messages[0].flags & MESSAGE_READ)
+            && messages[0].length == 1, 1 );
+
+    gotNAK = false;
+    transferBytes = 0;
+    message = messages;
+    messagesLeft = count - 1;
+
+    // the transfer completes on the STOP
+    DWire_clearInterruptFlag( module,
+            EUSCI_B_I2C_TRANSMIT_INTERRUPT0 | EUSCI_B_I2C_RECEIVE_INTERRUPT0
+                    | EUSCI_B_I2C_NAK_INTERRUPT | EUSCI_B_I2C_STOP_INTERRUPT );
+    DWire_enableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+
+    _loadMessage( true );
+    return false;
+}
+
+/**
+ * Send the (repeated) START of a message
+ */
+void DWire::_requestStart( const DWireMessage * message ) 
+{
+    if (message->address != slaveAddress)
     {
-        _resetBus( );
-        return true;
+        _setSlaveAddress( message->address );
     }
 
-    if (gotNAK) 
+    bool read = message->flags & MESSAGE_READ;
+    _started( message->address << 1 | read );
+    if (read)
     {
-        _I2CDelay( );
-        MAP_I2C_masterReceiveMultiByteStop( module );
+        DWire_setMode( module, EUSCI_B_I2C_RECEIVE_MODE );
+        DWire_masterReceiveStart( module );
+    }
+    else
+    {
+        DWire_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+        DWire_masterSendStart( module );
     }
-    return gotNAK;
 }
 
 /**
- * Request data from a SLAVE as a MASTER
+ * Point the ISR at the data of the current message. Its START is sent
+ * here if requested, otherwise _endMessage has already taken care of it
  */
-uint8_t DWire::requestFrom( uint_fast8_t slaveAddress, uint_fast8_t numBytes ) 
+void DWire::_loadMessage( bool start ) 
 {
-    // No point of doing anything else if there we're not a MASTER
-    if (busRole != BUS_ROLE_MASTER)
-        return 0;
+    const DWireMessage * m = message;
+    transferBytes += m->length;
 
-    // still something to send? Flush the TX buffer but do not send a STOP
-    if (*pTxBufferIndex > 0) 
+    if (m->flags & MESSAGE_READ)
     {
-    	// this is a repeated start: no point in trying to receive if we fail finishing the transmission
-        if (endTransmission( false ))
+        receiving = true;
+        *pRxBufferIndex = 0;
+        *pRxBufferSize = m->length;
+        *pRxData = m->data;
+        DWire_buffers[moduleIndex].rxDrop = m->length == 1 && !counterStop;
+
+        DWire_disableInterrupt( module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0 );
+        DWire_enableInterrupt( module,
+                EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+
+        if (start)
         {
-        	return 0;
+            _requestStart( m );
         }
-    } 
-    else 
-    {
-        // Wait until any request is finished
-        timeout = TIMEOUTLIMIT;
-        while ( MAP_I2C_masterIsStopSent( module ) == EUSCI_B_I2C_SENDING_STOP
-                && timeout)
-            timeout--;
-    }
-
-    if (!timeout) 
-    {
-        /* If we get a timeout, then reset everything */
-        _resetBus( );
-        return 0;
     }
-
-    // Re-initialise the rx buffer
-    // and make sure we never request 1 byte only
-    // this is an anomalous behaviour of the MSP432 related to the double
-    // buffering of I2C. This is a workaround.
-    if (numBytes == 1) 
+    else
     {
-        *pRxBufferSize = 2;
-    } else 
-    {
-        *pRxBufferSize = numBytes;
-    }
-    *pRxBufferIndex = 0;
-
-    // Configure the correct slave
-    MAP_I2C_setSlaveAddress( module, slaveAddress );
-    this->slaveAddress = slaveAddress;
+        receiving = false;
+        sendStop = !messagesLeft;
+        *pTxData = m->data;
+        *pTxBufferSize = m->length;
+        *pTxBufferIndex = m->length;
 
-    MAP_I2C_clearInterruptFlag( module,
-    EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
-    MAP_I2C_enableInterrupt( module,
-    EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+        DWire_disableInterrupt( module, EUSCI_B_I2C_RECEIVE_INTERRUPT0 );
 
-    // Set the master into receive mode
-    MAP_I2C_setMode( module, EUSCI_B_I2C_RECEIVE_MODE );
+        if (start)
+        {
+            _requestStart( m );
+        }
 
-    // Initialize the flag showing the status of the request
-    requestDone = false;
-    gotNAK = false;
+        // The first byte is loaded by the ISR once the START has been
+        // generated; a write without START directly follows the previous
+        // byte, from the TX interrupt that has just been taken
+        if (m->flags & MESSAGE_NOSTART)
+        {
+            _trace( TRACE_TX, m->data[0] );
+            EUSCI_B_CMSIS( module )->TXBUF = m->data[0];
+            DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+        }
+        else
+        {
+            firstPending = true;
+        }
 
-    // Send the START
-    MAP_I2C_masterReceiveStart( module );
+        DWire_enableInterrupt( module,
+                EUSCI_B_I2C_TRANSMIT_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+    }
+}
 
-    // Wait until the request is done
-    timeout = TIMEOUTLIMIT;
-    while (!requestDone && timeout)
-        timeout--;
+/**
+ * Called from the ISR on the TX interrupt of the START of a message: load
+ * its first byte
+ */
+void DWire::_sendFirstByte( void ) 
+{
+    uint8_t data = message->data[0];
+    firstPending = false;
+    DWire_masterSendMultiByteNext( module, data );
+    DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+    DWIRE_TRACE_EVENT( moduleIndex, TRACE_TX, data );
+}
 
-    if (!timeout)
+/**
+ * Called from the ISR once the last byte of a transmission has been
+ * moved to the shift register
+ */
+void DWire::_finishTransmit( void ) 
+{
+    if (message && messagesLeft)
     {
-        /* If we get a timeout, then reset everything */
-        _resetBus( );
-        return 0;
+        _endMessage( );
+        _nextMessage( );
     }
-
-    if (gotNAK) 
+    else if (readPending)
     {
-        _I2CDelay( );
-        MAP_I2C_masterReceiveMultiByteStop( module );
-        return 0;
-    } 
-    else 
+        // continue an asynchronous request with the repeated START
+        readPending = false;
+        _startRequest( readAddress, readBytes, readDMA );
+    }
+    else if (asyncTransfer)
     {
-        if (numBytes == 1)
+        if (sendStop)
         {
-            return --(*pRxBufferSize);
+            // complete once the STOP is out; the last byte may still be NAKed
+            DWire_clearInterruptFlag( module,
+                    EUSCI_B_I2C_STOP_INTERRUPT | EUSCI_B_I2C_NAK_INTERRUPT );
+            DWire_enableInterrupt( module,
+                    EUSCI_B_I2C_STOP_INTERRUPT | EUSCI_B_I2C_NAK_INTERRUPT );
         }
         else
         {
-            return *pRxBufferSize;
+            _finishTransfer( true );
         }
     }
 }
 
 /**
- * Reads a single byte from the rx buffer
+ * Called from the ISR when a STOP has been sent as a master, which ends
+ * DMA and asynchronous transfers, including NAKed ones
  */
-uint8_t DWire::read( void ) 
+void DWire::_finishStop( void ) 
 {
-    // Return a 0 if there is nothing to read or if the index is out of bounds
-    if ((*pRxBufferSize == 0) || (*pRxBufferIndex >= *pRxBufferSize) )
+    DWire_disableInterrupt( module,
+            EUSCI_B_I2C_STOP_INTERRUPT | EUSCI_B_I2C_NAK_INTERRUPT );
+
+    if (gotNAK)
     {
-    	*pRxBufferSize = 0;
-        return 0;
+        _completeAsync( TRANSFER_NAK );
+        _startNext( );
+    }
+    else if (receiving)
+    {
+        _finishRequest( true );
+    }
+    else
+    {
+        *pTxBufferIndex = 0;
+        _finishTransfer( true );
     }
-    // return the next byte and increment the index
-    // bounds checking is done at the next iteration of read
-    return pRxBuffer[(*pRxBufferIndex)++];
 }
 
 /**
- * Register the user's interrupt handler
+ * Called from the ISR when the current message of a combined transfer is
+ * about to end: request the START of the next one or the final STOP
  */
-void DWire::onRequest( void (*islHandle)( void ) ) 
+void DWire::_endMessage( void ) 
 {
-    user_onRequest = islHandle;
+    if (!messagesLeft)
+    {
+        DWire_masterReceiveMultiByteStop( module );
+    }
+    else if (!(message[1].flags & MESSAGE_NOSTART))
+    {
+        _requestStart( message + 1 );
+    }
 }
 
 /**
- * Register the interrupt handler
- * The argument contains the number of bytes received
+ * Called from the ISR when a message of a combined transfer has ended
  */
-void DWire::onReceive( void (*islHandle)( uint8_t ) ) 
+void DWire::_nextMessage( void ) 
 {
-    user_onReceive = islHandle;
-}
+    if (!messagesLeft)
+    {
+        DWire_disableInterrupt( module,
+                EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
 
-/**
- * Returns true if the module is configured as a master
- */
-bool DWire::isMaster( void ) 
-{
-	return busRole == BUS_ROLE_MASTER;
-}
+        // like requestFrom, let a waiting caller go on while the STOP is
+        // sent; otherwise the transfer completes on the STOP
+        if (blocking)
+        {
+            DWire_disableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+            _finishRequest( true );
+        }
+        return;
+    }
 
-/**** PRIVATE METHODS ****/
+    message++;
+    messagesLeft--;
+    _loadMessage( false );
+}
 
 /**
- * The main initialisation method to setup pins and interrupts
+ * Called from the ISR when the transmitter of a streaming write is empty
  */
-void DWire::_initMain( void ) 
+void DWire::_streamTransmit( void ) 
 {
-    requestDone = false;
-    sendStop = true;
+    uint8_t next;
 
-    switch (module) 
+    if (streamSource( &next ))
     {
-        case EUSCI_B0_BASE:
-
-			DWire_instances[0] = this;
-
-			pTxBuffer = EUSCIB0_txBuffer;
-			pTxBufferIndex = &EUSCIB0_txBufferIndex;
-			pTxBufferSize = &EUSCIB0_txBufferSize;
-
-			pRxBuffer = EUSCIB0_rxBuffer;
-			pRxBufferIndex = &EUSCIB0_rxBufferIndex;
-			pRxBufferSize = &EUSCIB0_rxBufferSize;
-
-			modulePort = EUSCI_B0_PORT;
-			modulePins = EUSCI_B0_PINS;
-			moduleSCL = EUSCI_B0_SCL;
-
-			intModule = INT_EUSCIB0;
-
-			MAP_I2C_registerInterrupt(module, EUSCIB0_IRQHandler_I2C);
-			break;
-
-        case EUSCI_B1_BASE:
-
-            DWire_instances[1] = this;
-
-            pTxBuffer = EUSCIB1_txBuffer;
-            pTxBufferIndex = &EUSCIB1_txBufferIndex;
-            pTxBufferSize = &EUSCIB1_txBufferSize;
-
-            pRxBuffer = EUSCIB1_rxBuffer;
-            pRxBufferIndex = &EUSCIB1_rxBufferIndex;
-            pRxBufferSize = &EUSCIB1_rxBufferSize;
-
-            modulePort = EUSCI_B1_PORT;
-            modulePins = EUSCI_B1_PINS;
-			moduleSCL = EUSCI_B1_SCL;
-
-            intModule = INT_EUSCIB1;
-
-            MAP_I2C_registerInterrupt( module, EUSCIB1_IRQHandler_I2C);
-            break;
-
-        case EUSCI_B2_BASE:
-
-            DWire_instances[2] = this;
-
-            pTxBuffer = EUSCIB2_txBuffer;
-            pTxBufferIndex = &EUSCIB2_txBufferIndex;
-            pTxBufferSize = &EUSCIB2_txBufferSize;
-
-            pRxBuffer = EUSCIB2_rxBuffer;
-            pRxBufferIndex = &EUSCIB2_rxBufferIndex;
-            pRxBufferSize = &EUSCIB2_rxBufferSize;
-
-            modulePort = EUSCI_B2_PORT;
-            modulePins = EUSCI_B2_PINS;
-			moduleSCL = EUSCI_B2_SCL;
-			
-            intModule = INT_EUSCIB2;
-
-            MAP_I2C_registerInterrupt(module, EUSCIB2_IRQHandler_I2C);
-            break;
-
-        case EUSCI_B3_BASE:
-
-            DWire_instances[3] = this;
-
-            pTxBuffer = EUSCIB3_txBuffer;
-            pTxBufferIndex = &EUSCIB3_txBufferIndex;
-            pTxBufferSize = &EUSCIB3_txBufferSize;
-
-            pRxBuffer = EUSCIB3_rxBuffer;
-            pRxBufferIndex = &EUSCIB3_rxBufferIndex;
-            pRxBufferSize = &EUSCIB3_rxBufferSize;
-
-            modulePort = EUSCI_B3_PORT;            ;
-            modulePins = EUSCI_B3_PINS;
-            moduleSCL = EUSCI_B3_SCL;
-
-            intModule = INT_EUSCIB3;
-
-            MAP_I2C_registerInterrupt(module, EUSCIB3_IRQHandler_I2C);
-            break;
-
-        default:
-            return;
+        DWire_masterSendMultiByteNext( module, next );
+        streamCount++;
+        DWIRE_COUNT( moduleIndex, bytesTx, 1 );
+        DWIRE_TRACE_EVENT( moduleIndex, TRACE_TX, next );
+    }
+    else
+    {
+        // the last byte is in the shift register
+        DWire_masterSendMultiByteStop( module );
+        DWire_disableInterrupt( module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0 );
     }
-    
-    // Initialise the receiver buffer and related variables
-    *pTxBufferIndex = 0;
-    *pRxBufferIndex = 0;
-    *pTxBufferSize = 0;
-    *pRxBufferSize = 0;
 }
 
 /**
- * Called to set the eUSCI module in 'master' mode
+ * Send the next probe of probeAsync, or complete it if there is none left
  */
-void DWire::_initMaster( const eUSCI_I2C_MasterConfig * i2cConfig ) 
-{
-    // Initialise the pins
-    MAP_GPIO_setAsPeripheralModuleFunctionInputPin( modulePort, modulePins,
-    GPIO_PRIMARY_MODULE_FUNCTION );
-
-    // Initializing I2C Master to SMCLK with no autostop
-    MAP_I2C_initMaster( module, i2cConfig );
-
-    // Specify slave address
-    MAP_I2C_setSlaveAddress( module, slaveAddress );
-
-    // Set Master in transmit mode
-    MAP_I2C_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
-
-    // Enable I2C Module to start operations
-    MAP_I2C_enableModule( module );
-
-    // Clear the interrupt flag
-    MAP_I2C_clearInterruptFlag( module,
-            EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT
-                    + EUSCI_B_I2C_RECEIVE_INTERRUPT0 );
-
-    // Register the interrupts on the correct module
-    MAP_Interrupt_enableInterrupt( intModule );
-    MAP_Interrupt_enableMaster( );
-}
-
-void DWire::_initSlave( void ) 
+void DWire::_nextProbe( void ) 
 {
-    // Init the pins
-    MAP_GPIO_setAsPeripheralModuleFunctionInputPin( modulePort, modulePins,
-    GPIO_PRIMARY_MODULE_FUNCTION );
-
-    // initialise driverlib
-    MAP_I2C_initSlave( module, slaveAddress, EUSCI_B_I2C_OWN_ADDRESS_OFFSET0,
-    EUSCI_B_I2C_OWN_ADDRESS_ENABLE );
-
-    // Enable the module and enable interrupts
-    MAP_I2C_enableModule( module );
-    MAP_I2C_clearInterruptFlag( module,
-            EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_STOP_INTERRUPT
-                    | EUSCI_B_I2C_TRANSMIT_INTERRUPT0 | EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT );
-    MAP_I2C_enableInterrupt( module,
-            EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_STOP_INTERRUPT
-                    | EUSCI_B_I2C_TRANSMIT_INTERRUPT0 | EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT );
+    uint8_t address = probeAddress;
+    while (address < 128 && !(probeSet[address >> 5] & (1UL << (address & 31))))
+    {
+        address++;
+    }
+    probeAddress = address;
 
-    /* Enable the clock low timeout */
-    EUSCI_B_CMSIS( module )->CTLW1 = (EUSCI_B_CMSIS( module )->CTLW1
-            & ~EUSCI_B_CTLW1_CLTO_MASK) | 0xC0;
+    if (address == 128)
+    {
+        DWire_disableInterrupt( module, EUSCI_B_I2C_STOP_INTERRUPT );
+        _completeAsync( TRANSFER_SUCCESS );
+        _startNext( );
+        return;
+    }
 
-    MAP_Interrupt_enableInterrupt( intModule );
-    MAP_Interrupt_enableMaster( );
+    DWire_setSlaveAddress( module, address );
+    slaveAddress = address;
+    DWire_clearInterruptFlag( module, EUSCI_B_I2C_NAK_INTERRUPT | EUSCI_B_I2C_STOP_INTERRUPT );
+    DWire_setMode( module, EUSCI_B_I2C_TRANSMIT_MODE );
+    _started( address << 1 );
+    DWire_masterSendStart( module );
+    // a STOP requested while the address is sent follows it, whether it
+    // is ACKed or not
+    DWire_masterReceiveMultiByteStop( module );
 }
 
 /**
- * Re-set the slave address (the target address when master or the slave's address when slave)
+ * Called from the ISR while probing, on the STOP that ends a probe. The
+ * NAK is only looked at then, without an interrupt of its own
  */
-void DWire::_setSlaveAddress( uint_fast8_t newAddress ) 
+void DWire::_probeInterrupt( uint_fast16_t status ) 
 {
-    slaveAddress = newAddress;
-    MAP_I2C_setSlaveAddress( module, newAddress );
+    if (status & EUSCI_B_I2C_STOP_INTERRUPT)
+    {
+        uint32_t & word = probePresent[probeAddress >> 5];
+        uint32_t bit = 1UL << (probeAddress & 31);
+        if (DWire_getInterruptStatus( module, EUSCI_B_I2C_NAK_INTERRUPT ))
+        {
+            DWIRE_TRACE_EVENT( moduleIndex, TRACE_NAK, 0 );
+            word &= ~bit;
+        }
+        else
+        {
+            word |= bit;
+            transferBytes++;
+        }
+        probeAddress++;
+        _nextProbe( );
+    }
 }
 
 /**
- * Handle a request ISL as a slave
+ * Called from the ISR for every byte of a streaming read. Without the byte
+ * counter, a single byte read takes two bytes (see _prepareRequest)
  */
-void DWire::_handleRequestSlave( void ) 
+void DWire::_streamReceive( uint8_t data ) 
 {
-    // Check whether a user interrupt has been set
-    if ( !user_onRequest )
-        return;
-
-    // If no message has been set, then call the user interrupt to set
-    if (!(*pTxBufferIndex)) 
+    // the second one is dropped
+    if (streamCount == streamLength)
     {
-        user_onRequest( );
-
-        *pTxBufferSize = *pTxBufferIndex - 1;
-        *pTxBufferIndex = 0;
+        DWire_disableInterrupt( module,
+                EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
+        return;
     }
 
-    // If we've transmitted the entire message, then reset the tx buffer
-    if (*pTxBufferIndex > *pTxBufferSize) 
+    streamSink( data );
+    streamCount++;
+
+    bool drop = streamLength == 1 && !counterStop;
+    if (streamCount == streamLength - 1 + drop && !counterStop)
     {
-        *pTxBufferIndex = 0;
-        *pTxBufferSize = 0;
-    } 
-    else 
+        DWire_masterReceiveMultiByteStop( module );
+    }
+    else if (streamCount == streamLength)
     {
-        // Transmit a byte
-        MAP_I2C_slavePutData( module, pTxBuffer[*pTxBufferIndex] );
-        (*pTxBufferIndex)++;
+        DWire_disableInterrupt( module,
+                EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_NAK_INTERRUPT );
     }
 }
 
-/**
- * Internal process handling the rx buffers, and calling the user's interrupt handles
- */
-void DWire::_handleReceive( uint8_t * rxBuffer ) 
+void DWire::_abortDMA( void ) 
 {
-    // No need to do anything if there is no handler registered
-    if (!user_onReceive)
-        return;
-
-    // reset the RX buffer index to prepare the readout
-    *pRxBufferIndex = 0;
+    uint32_t tx = DMACHANNEL( dmaTxMapping );
+    uint32_t rx = DMACHANNEL( dmaRxMapping );
 
-	// call the user-defined receive handler
-    user_onReceive( *pRxBufferSize );
-}
+#if DWIRE_STATISTICS
+    // take back the bytes a channel has not got to
+    if (MAP_DMA_isChannelEnabled( tx ))
+    {
+        DWIRE_COUNT( moduleIndex, bytesTx, -MAP_DMA_getChannelSize( UDMA_PRI_SELECT | tx ) );
+    }
+    if (MAP_DMA_isChannelEnabled( rx ))
+    {
+        DWIRE_COUNT( moduleIndex, bytesRx, -MAP_DMA_getChannelSize( UDMA_PRI_SELECT | rx ) );
+    }
+#endif
 
-void DWire::_finishRequest( bool success ) 
-{
-	// reset the RX buffer index to prepare the readout
-	*pRxBufferIndex = 0;
-	// mark the transaction as failed
-    gotNAK = !success;
-    // unlock the main thread
-    requestDone = true;
+    MAP_DMA_disableChannel( tx );
+    MAP_DMA_disableChannel( rx );
 }
 
 void DWire::_I2CDelay( void ) 
 {
-    // delay for 1.5 byte-times and send the stop
-    // this is needed because the MSP432 ignores any
-    // stop if the byte is being received / transmitted
+    // delay between the edges of the SCL pulses of a bus clear
 
     for (int i = 0; i < delayCycles; i++) 
 	{
@@ -798,6 +3922,9 @@ void DWire::_I2CDelay( void )
 
 void DWire::_resetBus( void ) 
 {
+    uint32_t start = DWire_time( );
+    DWIRE_COUNT( moduleIndex, busResets, 1 );
+
     /* Reset buffers */
     *pTxBufferIndex = 0;
     *pTxBufferSize = 0;
@@ -806,26 +3933,55 @@ void DWire::_resetBus( void )
 
     /* Reset the module */
     MAP_I2C_disableModule( module );
+    if (dmaEnabled)
+    {
+        _abortDMA( );
+    }
+    autoStop = false;
+
+    /* Abandon an asynchronous or queued transfer */
+    readPending = false;
+    watching = false;
+    if (asyncTransfer)
+    {
+        _completeAsync( TRANSFER_FAILED );
+    }
 
     /* Perform bus clear according to I2C-bus Specification and User Manual 
-     * (UM10204) section 3.1.16 
+     * (UM10204) section 3.1.16: clock SCL until a slave that holds SDA low
+     * lets go, at most 9 times, and end with a STOP to reset the slaves
      */
+    uint8_t pulses = 0;
     if (this->isMaster( )) 
     {
-        MAP_GPIO_setOutputLowOnPin( modulePort, moduleSCL );
-        for (uint_fast8_t i = 0; i < 9; i++) 
+        MAP_GPIO_setOutputLowOnPin( modulePort, modulePins );
+        MAP_GPIO_setAsInputPin( modulePort, modulePins );
+        for (; pulses < 9 && MAP_GPIO_getInputPinValue( modulePort,
+                moduleSDA ) == GPIO_INPUT_PIN_LOW; pulses++) 
         {
             MAP_GPIO_setAsOutputPin( modulePort, moduleSCL );
             this->_I2CDelay( );
             MAP_GPIO_setAsInputPin( modulePort, moduleSCL );
             this->_I2CDelay( );
         }
+
+        // SDA goes low while SCL is low and is released while SCL is high
+        MAP_GPIO_setAsOutputPin( modulePort, moduleSCL );
+        MAP_GPIO_setAsOutputPin( modulePort, moduleSDA );
+        this->_I2CDelay( );
+        MAP_GPIO_setAsInputPin( modulePort, moduleSCL );
+        this->_I2CDelay( );
+        MAP_GPIO_setAsInputPin( modulePort, moduleSDA );
+        this->_I2CDelay( );
+
         MAP_GPIO_setAsPeripheralModuleFunctionInputPin( modulePort,
-                moduleSCL, GPIO_PRIMARY_MODULE_FUNCTION );
+                modulePins, GPIO_PRIMARY_MODULE_FUNCTION );
     }
 
-    /* Re-enable the module */
+    /* Re-enable the module; its configuration is kept while in reset */
     MAP_I2C_enableModule( module );
+    recoveryTicks = DWire_time( ) - start;
+    _trace( TRACE_BUS_RESET, pulses );
 }
 
 
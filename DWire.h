@@ -18,23 +18,281 @@
 // Similar for the roles
 #define BUS_ROLE_MASTER 0
 #define BUS_ROLE_SLAVE 1
+// either role, as chosen by begin (see DWireT)
+#define BUS_ROLE_ANY 2
 
 // define I2C speed
 #define STANDARD 0
 #define FAST     1
 #define FASTPLUS 2
 
+// Status of an asynchronous transfer
+#define TRANSFER_PENDING 0
+#define TRANSFER_SUCCESS 1
+#define TRANSFER_NAK     2
+#define TRANSFER_FAILED  3
+
+// Flags of a DWireMessage
+#define MESSAGE_WRITE   0x00
+#define MESSAGE_READ    0x01
+// continue the preceding write without a repeated START
+#define MESSAGE_NOSTART 0x02
+
+// What a slave does when SCL is held low for too long
+// reset the eUSCI module and go on as a slave
+#define CLOCK_LOW_RESET_MODULE 0
+// reset the whole microcontroller
+#define CLOCK_LOW_HARD_RESET   1
+
 // Default buffer size in bytes
 #define TX_BUFFER_SIZE 256
 #define RX_BUFFER_SIZE 256
 
+// Own addresses of a slave, one per own address register of the eUSCI_B
+#define OWN_ADDRESSES 4
+
+// Words of a set of addresses (see DWire::probe): bit a & 31 of word a >> 5
+// stands for address a
+#define ADDRESS_WORDS 4
+
+// Modules of a group call (see DWire::probeGroup): bit n stands for eUSCI_Bn
+#define GROUP_B0 0x01
+#define GROUP_B1 0x02
+#define GROUP_B2 0x04
+#define GROUP_B3 0x08
+
+// Bytes of each of the two staged slave responses, see publishResponse
+#define RESPONSE_SIZE 32
+
+// Polls of the hardware while a START or STOP is being generated. These
+// waits are bounded by the count alone, not by setTimeout
 #define TIMEOUTLIMIT 0xFFFF
 
+// Default timeout of a master transfer in microseconds, see setTimeout.
+// It is an inactivity timeout: it runs out once the transfer has not moved
+// on for this long, and does not cover the START and STOP polls above
+#define DEFAULT_TIMEOUT 25000
+
+// The Timer32 module behind the timeouts, 0 or 1 (TIMER32_0_BASE or
+// TIMER32_1_BASE); it is shared by all DWire instances
+#ifndef DWIRE_TIMER32
+#define DWIRE_TIMER32 1
+#endif
+
+// Set to 1 to have the interrupt handlers and the start of a transfer
+// access the eUSCI_B registers directly instead of calling driverlib
+#ifndef DWIRE_DIRECT_REGISTERS
+#define DWIRE_DIRECT_REGISTERS 0
+#endif
+
+// Set to 0 to leave out the uDMA control table that DWire::enableDMA sets
+// up if the application has none; DMA transfers then need the table of the
+// application, set with DMA_setControlBase before begin
+#ifndef DWIRE_DMA_TABLE
+#define DWIRE_DMA_TABLE 1
+#endif
+
+// Set to 0 to leave out the counters of DWire::statistics
+#ifndef DWIRE_STATISTICS
+#define DWIRE_STATISTICS 1
+#endif
+
+// Set to 1 to record the bus events of every module in a trace ring, see
+// DWire::readTrace
+#ifndef DWIRE_TRACE
+#define DWIRE_TRACE 0
+#endif
+
+// Set to 1 to time the phases of every master transaction with the DWT
+// cycle counter, see DWire::latency
+#ifndef DWIRE_LATENCY
+#define DWIRE_LATENCY 0
+#endif
+
+// Transactions that can be queued per module, a power of two
+#define TRANSACTION_QUEUE_SIZE 8
+
+// Events in the trace ring of each module, a power of two
+#define TRACE_SIZE 64
+
+// Devices with latency histograms per module, and the buckets of a
+// histogram: bucket n counts the durations of 2^n up to 2^(n + 1) - 1
+// cycles, the last one also everything longer
+#define LATENCY_DEVICES 4
+#define LATENCY_BUCKETS 24
+
+// Phases of a master transaction (DWireLatency::histogram)
+// from the call (or queue) to the START
+#define LATENCY_QUEUED  0
+// from the START to the interrupt of the first byte, after the address ACK
+#define LATENCY_ADDRESS 1
+// from the first to the last byte interrupt
+#define LATENCY_DATA    2
+// from the last byte interrupt to the end, including the STOP
+#define LATENCY_STOP    3
+// from the call (or queue) to the end
+#define LATENCY_TOTAL   4
+#define LATENCY_PHASES  5
+
+// Events of the trace (DWireTraceEvent::type)
+// a START or repeated START, data: the address << 1, | 1 for a read
+#define TRACE_START     1
+// data: the byte loaded into the transmitter or received
+#define TRACE_TX        2
+#define TRACE_RX        3
+#define TRACE_NAK       4
+// a STOP seen by the interrupt handler (master: DMA and asynchronous)
+#define TRACE_STOP      5
+// master: the transfer has ended, data: 1 on success
+#define TRACE_DONE      6
+#define TRACE_TIMEOUT   7
+// data: the SCL pulses sent
+#define TRACE_BUS_RESET 8
+#define TRACE_CLOCK_LOW 9
+// slave: onRequest has been called, data: the bytes of the reply
+#define TRACE_REQUEST   10
+// slave: the whole reply has been sent, data: its length
+#define TRACE_REPLIED   11
+// slave: a frame is handed to onReceive or the frame ring, data: its length
+#define TRACE_RECEIVE   12
+// master: another master has won the arbitration, the transfer has failed
+#define TRACE_ARBITRATION 13
+
 #include <driverlib.h>
 
 /* Device specific includes */
 #include <inc/pins.h>
 
+/**
+ * Compile-time description of the eUSCI_B modules (e.g. DWireModule<0>
+ * for EUSCI_B0_BASE), used by DWireT and the interrupt handlers
+ */
+template <uint8_t M> struct DWireModule;
+
+template <> struct DWireModule<0>
+{
+    static const uint32_t base = EUSCI_B0_BASE;
+    static const uint32_t interrupt = INT_EUSCIB0;
+    static const uint_fast8_t port = EUSCI_B0_PORT;
+    static const uint_fast16_t pins = EUSCI_B0_PINS;
+    static const uint_fast16_t scl = EUSCI_B0_SCL;
+    static const uint_fast16_t sda = EUSCI_B0_SDA;
+    static const uint32_t dmaTx = DMA_CH0_EUSCIB0TX0;
+    static const uint32_t dmaRx = DMA_CH1_EUSCIB0RX0;
+};
+
+template <> struct DWireModule<1>
+{
+    static const uint32_t base = EUSCI_B1_BASE;
+    static const uint32_t interrupt = INT_EUSCIB1;
+    static const uint_fast8_t port = EUSCI_B1_PORT;
+    static const uint_fast16_t pins = EUSCI_B1_PINS;
+    static const uint_fast16_t scl = EUSCI_B1_SCL;
+    static const uint_fast16_t sda = EUSCI_B1_SDA;
+    static const uint32_t dmaTx = DMA_CH2_EUSCIB1TX0;
+    static const uint32_t dmaRx = DMA_CH3_EUSCIB1RX0;
+};
+
+template <> struct DWireModule<2>
+{
+    static const uint32_t base = EUSCI_B2_BASE;
+    static const uint32_t interrupt = INT_EUSCIB2;
+    static const uint_fast8_t port = EUSCI_B2_PORT;
+    static const uint_fast16_t pins = EUSCI_B2_PINS;
+    static const uint_fast16_t scl = EUSCI_B2_SCL;
+    static const uint_fast16_t sda = EUSCI_B2_SDA;
+    static const uint32_t dmaTx = DMA_CH4_EUSCIB2TX0;
+    static const uint32_t dmaRx = DMA_CH5_EUSCIB2RX0;
+};
+
+template <> struct DWireModule<3>
+{
+    static const uint32_t base = EUSCI_B3_BASE;
+    static const uint32_t interrupt = INT_EUSCIB3;
+    static const uint_fast8_t port = EUSCI_B3_PORT;
+    static const uint_fast16_t pins = EUSCI_B3_PINS;
+    static const uint_fast16_t scl = EUSCI_B3_SCL;
+    static const uint_fast16_t sda = EUSCI_B3_SDA;
+    static const uint32_t dmaTx = DMA_CH6_EUSCIB3TX0;
+    static const uint32_t dmaRx = DMA_CH7_EUSCIB3RX0;
+};
+
+/**
+ * One message of a combined transfer (see DWire::transfer). The messages
+ * are joined by repeated STARTs, with a STOP after the last one.
+ */
+struct DWireMessage
+{
+    uint8_t address;
+    uint8_t flags;      // MESSAGE_...
+    uint8_t length;
+    uint8_t * data;
+};
+
+/**
+ * A transaction for the queue of a DWire master: an optional write and an
+ * optional read, joined by a repeated START, or a list of messages. The
+ * structure and its buffers are in use by DWire from queue( ) until the
+ * transaction has completed.
+ */
+struct DWireTransaction
+{
+    uint8_t address;
+    const uint8_t * writeData;
+    uint8_t writeLength;
+    uint8_t * readData;
+    uint8_t readLength;
+    // called from the ISR on completion
+    void (*onComplete)( DWireTransaction * );
+    // used instead of the write and read if messageCount is not 0
+    DWireMessage * messages;
+    uint8_t messageCount;
+
+    /* Set by DWire */
+    volatile uint8_t status;    // TRANSFER_...
+    volatile uint8_t count;     // bytes read (or written, without a read)
+    uint32_t queued;            // cycle count when queued (DWIRE_LATENCY)
+};
+
+/**
+ * Counters of a module since startup or clearStatistics( ), see
+ * DWire::statistics. They stay 0 without DWIRE_STATISTICS
+ */
+struct DWireStatistics
+{
+    uint32_t transactions;      // master transfers, frames as a slave
+    uint32_t bytesTx;           // loaded into the transmitter
+    uint32_t bytesRx;
+    uint32_t naks;
+    uint32_t timeouts;
+    uint32_t busResets;
+    uint32_t arbitrationLosses; // transfers lost to another master
+    uint64_t waitTime;          // microseconds in the blocking master calls
+};
+
+/**
+ * An event of the trace ring, see DWire::readTrace
+ */
+struct DWireTraceEvent
+{
+    uint32_t time;      // microseconds (DWT cycles in the ring)
+    uint8_t type;       // TRACE_...
+    uint8_t data;
+};
+
+/**
+ * The latency histograms of a device, see DWire::latency. A phase that
+ * could not be seen (the bytes of a DMA transfer) is left out; only
+ * successful transactions are counted. When a bucket is full, all buckets
+ * of its phase are halved
+ */
+struct DWireLatency
+{
+    uint8_t address;
+    uint32_t transactions;
+    uint16_t histogram[LATENCY_PHASES][LATENCY_BUCKETS];
+};
+
 class DWire 
 {
 private:
@@ -44,44 +302,162 @@ private:
 	uint8_t * pTxBuffer;
     volatile uint8_t * pTxBufferIndex;
     volatile uint8_t * pTxBufferSize;
+    uint8_t ** pTxData;
 
 	/* RX buffer pointers */
     uint8_t * pRxBuffer;
     uint8_t * pRxBufferIndex;
     uint8_t * pRxBufferSize;
+    uint8_t ** pRxData;
 
     volatile bool requestDone;
     volatile bool sendStop;
     volatile bool gotNAK;
+    volatile bool receiving;
+    uint8_t transferBytes;
+
+    /* Asynchronous transfers */
+    volatile bool asyncTransfer;
+    volatile uint8_t asyncStatus;
+    volatile uint8_t asyncCount;
+    volatile bool readPending;
+    uint8_t readAddress;
+    uint8_t readBytes;
+    bool readDMA;
+    bool blocking;
+
+    /* Streaming transfers */
+    bool (*streamSource)( uint8_t * );
+    void (*streamSink)( uint8_t );
+    volatile bool streaming;
+    volatile uint32_t streamCount;
+    uint32_t streamLength;
+
+    /* Address-only probes (see probeAsync) */
+    const uint32_t * probeSet;
+    uint32_t * probePresent;
+    volatile uint8_t probeAddress;
+    volatile bool probing;
+
+    /* Combined transfers */
+    DWireMessage * volatile message;
+    uint8_t messagesLeft;
+    // the first byte of the message is loaded on the TX interrupt of its START
+    bool firstPending;
+
+    /* Transaction queue */
+    DWireTransaction * transactions[TRANSACTION_QUEUE_SIZE];
+    DWireTransaction * volatile current;
+    volatile uint8_t queueHead;
+    volatile uint8_t queueTail;
 
 	/* MSP specific modules */
+    uint8_t moduleIndex;
     uint_fast32_t module;
     uint32_t intModule;
     uint_fast8_t modulePort;
     uint_fast16_t modulePins;
     uint_fast16_t moduleSCL;
+    uint_fast16_t moduleSDA;
     
     /* Internal states */
     eUSCI_I2C_MasterConfig config;
     uint8_t mode;
     uint8_t slaveAddress;
+    // as a slave, see begin( addresses, count )
+    uint8_t ownAddresses[OWN_ADDRESSES];
+    uint8_t ownAddressCount;
     uint8_t busRole;
-    uint32_t timeout;
+    uint8_t clockLowPolicy;
+    // onClockLow is due after a clock low timeout (see process)
+    volatile bool clockLowPending;
+    // sleep in the blocking calls (see enableLowPower)
+    bool lowPower;
+
+    /* Timeouts (see setTimeout), in ticks of the Timer32 */
+    uint32_t timeoutMicros;
+    uint32_t timeoutTicks;
+    volatile uint32_t deadline;
+    volatile uint32_t progress;
+    volatile bool watching;
+    volatile bool expired;
+    // an asynchronous transfer has timed out, the bus is still to be cleared
+    volatile bool recoveryPending;
+    // duration of the last bus recovery (see recoveryTime)
+    uint32_t recoveryTicks;
+    // a timeout for the trace ring, with its cycle count (see _traceTimeout)
+    volatile bool timeoutTracePending;
+    volatile uint32_t timeoutCycles;
+
+    /* Phases of the current transaction (see latency): the cycle counts
+     * when it was started, of the START and of the first and last byte */
+    uint32_t latencyPoints[LATENCY_PHASES - 1];
+    volatile uint8_t latencySeen;
+
+    /* DMA transfers (see enableDMA) and the byte counter */
+    bool dmaEnabled;
+    bool byteCounterArmed;
+    bool autoStop;
+    // the byte counter sends the STOP of the current read
+    volatile bool counterStop;
+    uint32_t dmaTxMapping;
+    uint32_t dmaRxMapping;
     
-    void (*user_onRequest)( void );
-    void (*user_onReceive)( uint8_t );
+    /* Interrupt handlers of the module, per role */
+    void (*masterHandler)( void );
+    void (*slaveHandler)( void );
 
+    /* Per own address as a slave */
+    void (*user_onRequest[OWN_ADDRESSES])( void );
+    void (*user_onReceive[OWN_ADDRESSES])( uint8_t );
+    void (*user_onComplete)( uint8_t, uint8_t );
+    void (*user_onClockLow)( void );
+
+    void _initState( void );
     void _initMain( void );
     void _initMaster( const eUSCI_I2C_MasterConfig * );
     void _initSlave( void );
+    uint_fast16_t _slaveInterrupts( void );
     void _setSlaveAddress( uint_fast8_t );
+    int8_t _ownAddress( uint8_t );
+    void _registerBank( uint8_t, uint8_t *, uint16_t, const uint8_t * );
+    void _trace( uint8_t, uint8_t );
+    void _traceTimeout( void );
+    void _started( uint8_t );
+    void _recordLatency( bool );
+    bool _startTransmission( bool );
+    bool _prepareRequest( uint_fast8_t );
+    void _prepareCounter( bool, uint8_t );
+    void _startRequest( uint_fast8_t, uint_fast8_t, bool );
+    void _beginAsync( void );
+    void _completeAsync( uint8_t );
+    void _startNext( void );
+    void _startTransaction( DWireTransaction * );
+    bool _startStream( uint_fast8_t, uint32_t );
+    bool _checkMessages( const DWireMessage *, uint8_t );
+    bool _startMessages( DWireMessage *, uint8_t );
+    void _requestStart( const DWireMessage * );
+    void _loadMessage( bool );
+    void _wait( bool (DWire::*)( void ) );
+    static uint8_t _masters( uint8_t );
+    static void _waitGroup( uint8_t, bool (DWire::*)( void ) );
+    void _initTimeout( void );
+    void _startTimeout( void );
+    uint32_t _progress( void );
+    bool _awaitStop( void );
     void _I2CDelay( void );
     void _resetBus( void );
+    void _recover( void );
+    void _pollTimeout( void );
+    void _initDMA( void );
+    void _startDMA( uint32_t, uint32_t, void *, void *, uint8_t );
+    void _setByteCounter( uint8_t, uint_fast16_t );
+    void _clearByteCounter( void );
 
-    friend void EUSCIB0_IRQHandler_I2C( void );
-    friend void EUSCIB1_IRQHandler_I2C( void );
-    friend void EUSCIB2_IRQHandler_I2C( void );
-    friend void EUSCIB3_IRQHandler_I2C( void );
+protected:
+    /* For DWireT: the constructor runs the _bind of its module and role */
+    DWire( void (DWire::*)( void ) );
+    template <uint8_t M, uint8_t ROLE> void _bind( void );
 
 public:
     /* Constructors */
@@ -94,30 +470,133 @@ public:
     void setStandardMode( );
     void setFastMode( );
     void setFastModePlus( );
+    void enableDMA( void );
+    void disableDMA( void );
+    void enableLowPower( void );
+    void disableLowPower( void );
+    void setTimeout( uint32_t );
+    bool timedOut( void );
+    uint32_t recoveryTime( void );
+    void statistics( DWireStatistics * );
+    void clearStatistics( void );
+    uint8_t readTrace( DWireTraceEvent *, uint8_t );
+    uint32_t traceLost( void );
+    uint32_t latency( uint_fast8_t, DWireLatency * );
+    uint32_t latencyPercentile( uint_fast8_t, uint8_t, uint8_t );
+    void clearLatency( void );
 
     void beginTransmission( uint_fast8_t );
     void write( uint_fast8_t );
+    size_t write( const uint8_t *, size_t );
     bool endTransmission( void );
     bool endTransmission( bool );
 
     uint8_t requestFrom( uint_fast8_t, uint_fast8_t );
+    uint8_t requestFrom( uint_fast8_t, uint8_t *, uint_fast8_t );
+
+    bool transfer( DWireMessage *, uint8_t );
+    bool transferAsync( DWireMessage *, uint8_t );
+    bool readRegister( uint_fast8_t, uint8_t, uint8_t *, uint8_t );
+    bool writeRegister( uint_fast8_t, uint8_t, const uint8_t *, uint8_t );
+    bool writeRegister( uint_fast8_t, uint8_t, uint8_t );
+
+    bool endTransmissionAsync( void );
+    bool endTransmissionAsync( bool );
+    bool requestFromAsync( uint_fast8_t, uint_fast8_t );
+    bool writeStreamAsync( uint_fast8_t, bool (*)( uint8_t * ) );
+    bool readStreamAsync( uint_fast8_t, uint32_t, void (*)( uint8_t ) );
+    uint32_t streamedBytes( void );
+    bool probe( const uint32_t *, uint32_t * );
+    bool probeAsync( const uint32_t *, uint32_t * );
+    void onComplete( void (*)( uint8_t, uint8_t ) );
+    uint8_t transferStatus( void );
+    uint8_t transferCount( void );
+    bool process( void );
+
+    bool queue( DWireTransaction * );
+    uint8_t queueLength( void );
+
+    /* Groups of master modules, run side by side */
+    static bool probeGroup( uint8_t, const uint32_t *, uint32_t (*)[ADDRESS_WORDS] );
+    static bool transferGroup( DWireTransaction *, const uint8_t *, uint8_t );
+    static void waitGroup( uint8_t );
 
     /* SLAVE specific */
     void begin( uint8_t );
+    void begin( const uint8_t *, uint8_t );
 
     uint8_t read( void );
+    uint8_t matchedAddress( void );
 
     void onRequest( void (*)( void ) );
     void onReceive( void (*)( uint8_t ) );
+    bool onRequest( uint8_t, void (*)( void ) );
+    bool onReceive( uint8_t, void (*)( uint8_t ) );
+    void onClockLow( void (*)( void ) );
+    void setClockLowPolicy( uint8_t );
+    void registerBank( uint8_t *, uint16_t, const uint8_t * );
+    bool registerBank( uint8_t, uint8_t *, uint16_t, const uint8_t * );
+    uint8_t * responseBuffer( void );
+    bool publishResponse( uint8_t );
+    // a ring of a power of two bytes, other sizes are rounded down
+    void receiveFrames( uint8_t *, uint16_t );
+    uint8_t readFrame( uint8_t *, uint8_t );
+    uint32_t framesLost( void );
+    void onRegisterWrite( void (*)( uint8_t, uint8_t ) );
+    bool onRegisterWrite( uint8_t, void (*)( uint8_t, uint8_t ) );
 
     /* Miscellaneous */
     bool isMaster( void );
 
     /* Internal */
-    void _handleReceive( uint8_t * );
+    void _handleReceive( void );
     void _handleRequestSlave( void );
+    void _handleClockLow( void );
     void _finishRequest( bool );
+    void _finishTransmit( void );
+    void _finishTransfer( bool );
+    void _finishStop( void );
+    void _arbitrationLost( void );
+    void _endMessage( void );
+    void _streamTransmit( void );
+    void _streamReceive( uint8_t );
+    void _nextMessage( void );
+    void _sendFirstByte( void );
+    void _nextProbe( void );
+    void _probeInterrupt( uint_fast16_t );
+    void _abortDMA( void );
+    void _markByte( void );
+    uint32_t _checkTimeout( uint32_t );
     bool _isSendStop( ) { return sendStop; }
+    bool _isDMA( ) { return dmaEnabled; }
+    bool _isAsync( ) { return asyncTransfer; }
+    bool _isSending( ) { return *pTxBufferIndex && !expired; }
+    bool _isRequesting( ) { return !requestDone && !expired; }
+    bool _isRunning( ) { return asyncStatus == TRANSFER_PENDING && !expired; }
+    bool _isCounterStop( ) { return counterStop; }
+    bool _isMessage( ) { return message != 0; }
+    bool _isFirstPending( ) { return firstPending; }
+    bool _isStreaming( ) { return streaming; }
+    bool _isProbing( ) { return probing; }
+    bool _isQueueFull( ) { return (uint8_t) (queueTail - queueHead) == TRANSACTION_QUEUE_SIZE; }
+};
+
+/**
+ * A DWire on the eUSCI module given at compile time, e.g. DWireT<2> for
+ * EUSCI_B2_BASE; DWireT<M>::Module describes the module. Only the
+ * interrupt handlers of the module are linked in, and only that of ROLE
+ * if it is given: DWireT<0, BUS_ROLE_SLAVE> can only begin as a slave.
+ * The registers, the buffers and the role are constants in the handler;
+ * the rest of the state (the transfer in progress, the callbacks) is still
+ * reached through the instance pointer of the module, as for DWire( n )
+ */
+template <uint8_t M, uint8_t ROLE = BUS_ROLE_ANY>
+class DWireT : public DWire
+{
+public:
+    typedef DWireModule<M> Module;
+
+    DWireT( ) : DWire( &DWireT::template _bind<M, ROLE> ) { }
 };
 
 #endif /* DWIRE_DWIRE_H_ */
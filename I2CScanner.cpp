@@ -13,6 +13,10 @@
 
 #include "I2CScanner.h"
 
+// addresses 1 to 125, those of scan, as a set of DWire::probe
+static const uint32_t scanAddresses[ADDRESS_WORDS] = { 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF,
+        0x3FFFFFFF };
+
 /**
  *
  *   Scan the I2C bus and list the available devices.
@@ -73,3 +77,107 @@ unsigned char I2CScanner::scan(DWire &i2c, unsigned char start, unsigned char en
     
     return devices;
 }
+
+/**
+ *
+ *   Scan the I2C bus with address-only probes, which are sent one after
+ *   the other by the interrupt handler, and mark the devices found in
+ *   present (ADDRESS_WORDS words, see DWire::probe). The addresses that
+ *   are not scanned are left as they are.
+ *   
+ *   Returns:
+ *   unsigned char        number of devices found
+ *
+ */
+unsigned char I2CScanner::fastScan(DWire &i2c, uint32_t *present)
+{
+    if (i2c.probe(scanAddresses, present))
+    {
+        return 0;
+    }
+
+    unsigned char devices = 0;
+    for(unsigned char word = 0; word < ADDRESS_WORDS; word++ )
+    {
+        devices += __builtin_popcount(present[word] & scanAddresses[word]);
+    }
+    return devices;
+}
+
+/**
+ *
+ *   Scan the buses of a group of DWire masters (GROUP_B0 to GROUP_B3) at
+ *   the same time, as fastScan does for one, which takes about as long
+ *   as the slowest bus alone. present[n] receives the devices on eUSCI_Bn.
+ *   
+ *   Returns:
+ *   unsigned char        number of devices found on all buses together
+ *
+ */
+unsigned char I2CScanner::fastScanGroup(uint8_t group, uint32_t (*present)[ADDRESS_WORDS])
+{
+    if (DWire::probeGroup(group, scanAddresses, present))
+    {
+        return 0;
+    }
+
+    unsigned char devices = 0;
+    for(unsigned char module = 0; module < 4; module++ )
+    {
+        if (!(group & (1 << module)))
+        {
+            continue;
+        }
+        for(unsigned char word = 0; word < ADDRESS_WORDS; word++ )
+        {
+            devices += __builtin_popcount(present[module][word] & scanAddresses[word]);
+        }
+    }
+    return devices;
+}
+
+/**
+ *
+ *   Probe the addresses whose state is not known yet (or no more, once
+ *   their bit in state.known has been cleared) and refresh the next
+ *   refresh addresses in turn, so that every address is probed again
+ *   after a number of calls. Cheap enough to run often to detect devices
+ *   that come and go.
+ *   
+ *   Returns:
+ *   unsigned char        number of devices that appeared or disappeared
+ *
+ */
+unsigned char I2CScanner::rescan(DWire &i2c, I2CScanState &state, unsigned char refresh)
+{
+    uint32_t addresses[ADDRESS_WORDS];
+    uint32_t before[ADDRESS_WORDS];
+    for(unsigned char word = 0; word < ADDRESS_WORDS; word++ )
+    {
+        addresses[word] = ~state.known[word] & scanAddresses[word];
+        before[word] = state.present[word];
+    }
+
+    for(unsigned char i = 0; i < refresh; i++ )
+    {
+        if (state.next < 1 || state.next > 125)
+        {
+            state.next = 1;
+        }
+        addresses[state.next >> 5] |= 1UL << (state.next & 31);
+        state.next++;
+    }
+
+    if (i2c.probe(addresses, state.present))
+    {
+        return 0;
+    }
+
+    unsigned char changes = 0;
+    for(unsigned char word = 0; word < ADDRESS_WORDS; word++ )
+    {
+        state.known[word] |= addresses[word];
+        changes += __builtin_popcount(before[word] ^ state.present[word]);
+    }
+    return changes;
+}
@@ -16,6 +16,17 @@
 
 #include <DWire.h>
 
+/**
+ * What the scans of a bus have found, kept between the calls of rescan.
+ * All zero, every address is unknown
+ */
+struct I2CScanState
+{
+    uint32_t present[ADDRESS_WORDS];    // the addresses ACKed
+    uint32_t known[ADDRESS_WORDS];      // the addresses probed, clear a bit to probe it again
+    unsigned char next;                 // the next address refreshed by rescan
+};
+
 class I2CScanner
 {
 
@@ -23,6 +34,9 @@ public:
     static unsigned char scan( DWire& );
     static unsigned char scan(DWire&, void (*)( unsigned char ));
     static unsigned char scan(DWire &, unsigned char, unsigned char, void (*)( unsigned char ));        
+    static unsigned char fastScan(DWire &, uint32_t *);
+    static unsigned char fastScanGroup(uint8_t, uint32_t (*)[ADDRESS_WORDS]);
+    static unsigned char rescan(DWire &, I2CScanState &, unsigned char);
 };
 
 #endif
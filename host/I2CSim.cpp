@@ -0,0 +1,1587 @@
+/*
+ * DWire host simulation: eUSCI_B bus model.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "I2CSim.h"
+
+/* Device specific pin mapping, used to locate SCL/SDA of each bus */
+#include <inc/pins.h>
+
+/**** Register and state definitions ****/
+
+/* Register positions in EUSCI_B_Type, in 16-bit words */
+#define REG_CTLW0   0
+#define REG_CTLW1   1
+#define REG_BRW     3
+#define REG_STATW   4
+#define REG_TBCNT   5
+#define REG_RXBUF   6
+#define REG_TXBUF   7
+#define REG_IE      21
+#define REG_IFG     22
+
+#define RXIFG_ALL (EUSCI_B_IFG_RXIFG0 | EUSCI_B_IFG_RXIFG1 | EUSCI_B_IFG_RXIFG2 | EUSCI_B_IFG_RXIFG3)
+#define TXIFG_ALL (EUSCI_B_IFG_TXIFG0 | EUSCI_B_IFG_TXIFG1 | EUSCI_B_IFG_TXIFG2 | EUSCI_B_IFG_TXIFG3)
+
+/* One event slot per bus, the remaining ones for other peripherals */
+#define EVENT_SLOTS 8
+#define TIMER_SLOT( n ) (I2CSIM_BUSES + (n))
+#define VECTORS 64
+
+/* DMA_assignChannel source selection of the eUSCI_B TX0/RX0 triggers */
+#define DMA_SOURCE_EUSCIB 2
+
+enum MasterState
+{
+    M_IDLE,
+    M_ADDRESS,      // START and address byte on the bus
+    M_TX,           // data byte being transmitted
+    M_RX,           // data byte being received
+    M_RX_STALL,     // byte received, RXBUF still full: SCL held low
+    M_HOLD_TX,      // TXBUF empty after a byte: SCL held low
+    M_HOLD_NACK,    // NAK received, waiting for STOP or repeated START
+    M_STOP          // STOP condition on the bus
+};
+
+struct SimBus
+{
+    EUSCI_B_Type regs;
+    I2CSimDevice * devices[I2CSIM_DEVICES];
+    I2CSimDevice * target;
+    uint8_t state;
+    uint8_t shift;
+    bool txFull;
+    uint8_t count;
+    bool sclLow;
+    bool sdaLow;            // driven low through GPIO
+    uint8_t sdaHeld;        // SCL pulses a stuck slave holds SDA low for
+    bool loseNext;          // another master wins the next address
+    uint64_t busyUntil;     // end of the other master's transfer
+    bool hadStop;
+    uint64_t busyFrom;
+    uint64_t lastStop;
+    uint32_t masterRate;
+    I2CSim::Stats stats;
+};
+
+struct SimEvent
+{
+    bool armed;
+    uint64_t at;
+    void (*fire)( uint8_t );
+    uint8_t arg;
+};
+
+static const uint16_t rxFlag[4] = { EUSCI_B_IFG_RXIFG0, EUSCI_B_IFG_RXIFG1,
+        EUSCI_B_IFG_RXIFG2, EUSCI_B_IFG_RXIFG3 };
+static const uint16_t txFlag[4] = { EUSCI_B_IFG_TXIFG0, EUSCI_B_IFG_TXIFG1,
+        EUSCI_B_IFG_TXIFG2, EUSCI_B_IFG_TXIFG3 };
+
+static const uint8_t busPort[I2CSIM_BUSES] = { EUSCI_B0_PORT, EUSCI_B1_PORT,
+        EUSCI_B2_PORT, EUSCI_B3_PORT };
+static const uint16_t busScl[I2CSIM_BUSES] = { EUSCI_B0_SCL, EUSCI_B1_SCL,
+        EUSCI_B2_SCL, EUSCI_B3_SCL };
+static const uint16_t busSda[I2CSIM_BUSES] = { EUSCI_B0_SDA, EUSCI_B1_SDA,
+        EUSCI_B2_SDA, EUSCI_B3_SDA };
+
+static SimBus buses[I2CSIM_BUSES];
+static SimEvent events[EVENT_SLOTS];
+static I2CSim::DmaChannel dma[I2CSIM_DMA_CHANNELS];
+static I2CSim::Timer32 timers[I2CSIM_TIMERS];
+static void (*vectors[VECTORS])( void );
+static bool nvicEnabled[VECTORS];
+static bool interruptsEnabled;
+
+static uint64_t cycles;
+static uint32_t mclk;
+static uint32_t smclk;
+static bool autoRun;
+static bool initialised;
+static int isrDepth;
+static int isrBus;
+static int callDepth;
+static uint32_t resets;
+
+static uint8_t portOut[11];
+static uint8_t portDir[11];
+static uint8_t portSel[11];
+
+static void dmaService( void );
+
+/**** Scheduling ****/
+
+/**
+ * Bring the simulator into its power-on state on first use, which may
+ * come from a static constructor
+ */
+static void initialise( void )
+{
+    if (!initialised)
+    {
+        I2CSim::reset( );
+    }
+}
+
+static struct SimPowerOn
+{
+    SimPowerOn( ) { initialise( ); }
+} powerOn;
+
+
+static void schedule( uint8_t slot, uint64_t at, void (*fire)( uint8_t ), uint8_t arg )
+{
+    events[slot].armed = true;
+    events[slot].at = at;
+    events[slot].fire = fire;
+    events[slot].arg = arg;
+}
+
+static int nextEvent( void )
+{
+    int next = -1;
+    for (int i = 0; i < EVENT_SLOTS; i++)
+    {
+        if (events[i].armed && (next < 0 || events[i].at < events[next].at))
+        {
+            next = i;
+        }
+    }
+    return next;
+}
+
+/**
+ * Fire a single event, moving the clock forward if it lies in the future.
+ * When wait is set, the CPU is considered blocked in the DWire API.
+ */
+static void fire( int e, bool wait )
+{
+    if (events[e].at > cycles)
+    {
+        if (wait && e < I2CSIM_BUSES)
+        {
+            buses[e].stats.waitCycles += events[e].at - cycles;
+        }
+        cycles = events[e].at;
+    }
+    events[e].armed = false;
+    events[e].fire( events[e].arg );
+    dmaService( );
+}
+
+/**
+ * The pending interrupt enabled in the NVIC with the lowest number, or -1
+ */
+static int pendingInterrupt( void )
+{
+    for (int n = INT_EUSCIB0; n <= INT_EUSCIB3; n++)
+    {
+        SimBus & b = buses[n - INT_EUSCIB0];
+        if (nvicEnabled[n] && vectors[n] && (b.regs.IFG.value & b.regs.IE.value))
+            return n;
+    }
+
+    for (int n = 0; n < I2CSIM_TIMERS; n++)
+    {
+        int vector = INT_T32_INT1 + n;
+        if (nvicEnabled[vector] && vectors[vector] && timers[n].pending
+                && (timers[n].control & TIMER32_CONTROL_IE))
+            return vector;
+    }
+    return -1;
+}
+
+/**
+ * Invoke the handlers of all pending and enabled interrupts, until none
+ * are left. Nested interrupts are not modelled.
+ */
+static void dispatch( void )
+{
+    dmaService( );
+    if (isrDepth || !interruptsEnabled)
+        return;
+
+    for (uint32_t guard = 0;; guard++)
+    {
+        int pending = pendingInterrupt( );
+        if (pending < 0)
+            return;
+
+        if (guard > 1000000)
+        {
+            fprintf( stderr, "I2CSim: interrupt %d is never cleared\n", pending );
+            abort( );
+        }
+
+        // the register accesses of the handler let the bus advance, also
+        // when it interrupts a driverlib call (e.g. a polling loop)
+        int interruptedCalls = callDepth;
+        callDepth = 0;
+        isrDepth++;
+        isrBus = pending <= INT_EUSCIB3 ? pending - INT_EUSCIB0 : -1;
+        if (isrBus >= 0)
+        {
+            buses[isrBus].stats.isrEntries++;
+        }
+        I2CSim::_charge( I2CSim::ISR_OVERHEAD_CYCLES );
+        vectors[pending]( );
+        isrBus = -1;
+        isrDepth--;
+        callDepth = interruptedCalls;
+    }
+}
+
+/**
+ * Process events up to the given time
+ */
+static void run( uint64_t limit, bool wait )
+{
+    dispatch( );
+    for (;;)
+    {
+        int e = nextEvent( );
+        if (e < 0 || events[e].at > limit)
+            break;
+
+        fire( e, wait );
+        dispatch( );
+    }
+}
+
+/**
+ * Process events until no bus has anything left to do; a timer only fires
+ * on the way if it is due before that
+ */
+static void settle( void )
+{
+    dispatch( );
+    for (;;)
+    {
+        bool busy = false;
+        for (int m = 0; m < I2CSIM_BUSES; m++)
+        {
+            busy |= events[m].armed;
+        }
+        if (!busy)
+            break;
+
+        fire( nextEvent( ), true );
+        dispatch( );
+    }
+
+    // anything else that has become due by now
+    run( cycles, false );
+}
+
+/**
+ * Let time pass on the bus while the CPU is free to run interrupts
+ */
+static void elapse( uint64_t delta )
+{
+    uint64_t until = cycles + delta;
+    run( until, false );
+    if (cycles < until)
+    {
+        cycles = until;
+    }
+}
+
+/**
+ * Outside interrupt context, run the simulation until the bus is quiescent
+ * (or up to the current time without auto-run)
+ */
+static void service( void )
+{
+    // the bus keeps going while the CPU runs an interrupt handler
+    if (isrDepth)
+    {
+        run( cycles, false );
+        return;
+    }
+
+    callDepth++;
+    if (autoRun)
+    {
+        settle( );
+    }
+    else
+    {
+        // only what has become due during the CPU time charged so far
+        run( cycles, false );
+    }
+    callDepth--;
+}
+
+/**** Bus master state machine ****/
+
+static uint32_t bitTime( SimBus & b )
+{
+    uint32_t prescaler = b.regs.BRW.value ? b.regs.BRW.value : 1;
+    return (uint32_t) ((uint64_t) mclk * prescaler / smclk);
+}
+
+static I2CSimDevice * findDevice( SimBus & b, uint8_t address )
+{
+    for (int i = 0; i < I2CSIM_DEVICES; i++)
+    {
+        if (b.devices[i] && b.devices[i]->address == address)
+            return b.devices[i];
+    }
+    return 0;
+}
+
+static void busEvent( uint8_t );
+
+static void busAfter( uint8_t m, uint32_t bits )
+{
+    schedule( m, cycles + (uint64_t) bits * bitTime( buses[m] ), busEvent, m );
+}
+
+static void deferredStart( uint8_t );
+
+static void masterStart( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    // the bus is not free while a slave holds SDA low: the START waits
+    if (b.sdaHeld)
+        return;
+
+    // nor while the master that won the arbitration goes on
+    if (b.state == M_IDLE && cycles < b.busyUntil)
+    {
+        schedule( m, b.busyUntil, deferredStart, m );
+        return;
+    }
+
+    if (b.state != M_IDLE)
+    {
+        b.stats.restarts++;
+    }
+    else
+    {
+        if (b.hadStop)
+        {
+            b.stats.gapCycles += cycles - b.lastStop;
+            b.stats.gaps++;
+        }
+        b.busyFrom = cycles;
+        b.regs.STATW.value |= EUSCI_B_STATW_BBUSY;
+    }
+    b.stats.starts++;
+
+    b.count = 0;
+    b.txFull = false;
+    b.regs.STATW.value &= ~EUSCI_B_STATW_BCNT_MASK;
+
+    // the transmitter can be loaded as soon as the START is generated
+    if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TR)
+    {
+        b.regs.IFG.value |= EUSCI_B_IFG_TXIFG0;
+    }
+
+    // START plus the address byte with its ACK bit
+    b.state = M_ADDRESS;
+    busAfter( m, 10 );
+}
+
+static void deferredStart( uint8_t m )
+{
+    uint16_t control = buses[m].regs.CTLW0.value;
+    if ((control & EUSCI_B_CTLW0_MST) && (control & EUSCI_B_CTLW0_TXSTT))
+    {
+        masterStart( m );
+    }
+}
+
+/**
+ * Another master has sent a lower address: the eUSCI drops to a slave,
+ * which is not addressed, and the other transfer holds the bus for a
+ * data byte and its STOP
+ */
+static void arbitrationLost( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.loseNext = false;
+    b.regs.CTLW0.value &= ~(EUSCI_B_CTLW0_MST | EUSCI_B_CTLW0_TXSTT | EUSCI_B_CTLW0_TXSTP);
+    b.regs.IFG.value = (b.regs.IFG.value & ~EUSCI_B_IFG_TXIFG0) | EUSCI_B_IFG_ALIFG;
+    b.txFull = false;
+    b.state = M_IDLE;
+
+    b.busyUntil = cycles + (uint64_t) 10 * bitTime( b );
+    b.stats.busyCycles += b.busyUntil - b.busyFrom;
+    b.lastStop = b.busyUntil;
+    b.hadStop = true;
+}
+
+static void masterStop( uint8_t m )
+{
+    buses[m].state = M_STOP;
+    busAfter( m, 1 );
+}
+
+static void masterNack( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.stats.naks++;
+    b.txFull = false;
+    b.regs.IFG.value = (b.regs.IFG.value & ~EUSCI_B_IFG_TXIFG0) | EUSCI_B_IFG_NACKIFG;
+
+    if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTP)
+    {
+        masterStop( m );
+    }
+    else
+    {
+        b.state = M_HOLD_NACK;
+    }
+}
+
+static void masterShift( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    // TXBUF moves into the shift register and can be reloaded
+    b.shift = (uint8_t) b.regs.TXBUF.value;
+    b.txFull = false;
+    b.regs.IFG.value |= EUSCI_B_IFG_TXIFG0;
+    b.state = M_TX;
+    busAfter( m, 9 );
+}
+
+static bool countByte( SimBus & b )
+{
+    b.count++;
+    b.regs.STATW.value = (b.regs.STATW.value & ~EUSCI_B_STATW_BCNT_MASK)
+            | (b.count << EUSCI_B_STATW_BCNT_OFS);
+
+    uint16_t autoStop = b.regs.CTLW1.value & EUSCI_B_CTLW1_ASTP_MASK;
+    if (autoStop && b.regs.TBCNT.value && b.count == b.regs.TBCNT.value)
+    {
+        b.regs.IFG.value |= EUSCI_B_IFG_BCNTIFG;
+        return autoStop == EUSCI_B_CTLW1_ASTP_2;
+    }
+    return false;
+}
+
+static void addressDone( uint8_t m )
+{
+    SimBus & b = buses[m];
+    bool read = !(b.regs.CTLW0.value & EUSCI_B_CTLW0_TR);
+
+    if (b.loseNext)
+    {
+        arbitrationLost( m );
+        return;
+    }
+
+    b.target = findDevice( b, b.regs.I2CSA.value & 0x7F );
+    b.regs.CTLW0.value &= ~EUSCI_B_CTLW0_TXSTT;
+
+    if (!b.target || !b.target->onAddress( read ))
+    {
+        masterNack( m );
+        return;
+    }
+
+    if (read)
+    {
+        b.state = M_RX;
+        busAfter( m, 9 );
+    }
+    else if (b.txFull)
+    {
+        masterShift( m );
+    }
+    else if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTP)
+    {
+        // address-only transfer
+        masterStop( m );
+    }
+    else
+    {
+        b.state = M_HOLD_TX;
+    }
+}
+
+static void txDone( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.stats.bytesTx++;
+    if (!b.target->onWrite( b.shift ))
+    {
+        masterNack( m );
+        return;
+    }
+
+    if (countByte( b ) || (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTP))
+    {
+        masterStop( m );
+    }
+    else if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTT)
+    {
+        masterStart( m );
+    }
+    else if (b.txFull)
+    {
+        masterShift( m );
+    }
+    else
+    {
+        b.state = M_HOLD_TX;
+    }
+}
+
+static void rxDeliver( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.stats.bytesRx++;
+    b.regs.RXBUF.value = b.shift;
+    b.regs.IFG.value |= EUSCI_B_IFG_RXIFG0;
+    b.regs.STATW.value &= ~EUSCI_B_STATW_SCLLOW;
+
+    // the byte is NAKed when a STOP is pending, ending the transfer
+    if (countByte( b ) || (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTP))
+    {
+        masterStop( m );
+    }
+    else if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTT)
+    {
+        masterStart( m );
+    }
+    else
+    {
+        b.state = M_RX;
+        busAfter( m, 9 );
+    }
+}
+
+static void rxDone( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.shift = b.target->onRead( );
+    if (b.regs.IFG.value & EUSCI_B_IFG_RXIFG0)
+    {
+        // the previous byte has not been read yet: stretch the clock
+        b.state = M_RX_STALL;
+        b.regs.STATW.value |= EUSCI_B_STATW_SCLLOW;
+        return;
+    }
+    rxDeliver( m );
+}
+
+static void stopDone( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.regs.CTLW0.value &= ~EUSCI_B_CTLW0_TXSTP;
+    b.regs.IFG.value |= EUSCI_B_IFG_STPIFG;
+    b.regs.STATW.value &= ~EUSCI_B_STATW_BBUSY;
+
+    b.stats.stops++;
+    b.stats.busyCycles += cycles - b.busyFrom;
+    b.lastStop = cycles;
+    b.hadStop = true;
+
+    if (b.target)
+    {
+        b.target->onStop( );
+        b.target = 0;
+    }
+    b.state = M_IDLE;
+
+    if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXSTT)
+    {
+        masterStart( m );
+    }
+}
+
+static void busEvent( uint8_t m )
+{
+    switch (buses[m].state)
+    {
+        case M_ADDRESS:
+            addressDone( m );
+            break;
+
+        case M_TX:
+            txDone( m );
+            break;
+
+        case M_RX:
+            rxDone( m );
+            break;
+
+        case M_RX_STALL:
+            rxDeliver( m );
+            break;
+
+        case M_STOP:
+            stopDone( m );
+            break;
+    }
+}
+
+static void moduleReset( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    events[m].armed = false;
+    if (b.state != M_IDLE)
+    {
+        // the bus is released without a STOP
+        b.stats.busyCycles += cycles - b.busyFrom;
+        b.lastStop = cycles;
+        b.hadStop = true;
+    }
+    b.state = M_IDLE;
+    b.target = 0;
+    b.txFull = false;
+    b.regs.CTLW0.value &= ~(EUSCI_B_CTLW0_TXSTT | EUSCI_B_CTLW0_TXSTP | EUSCI_B_CTLW0_TXNACK);
+    b.regs.STATW.value = 0;
+    b.regs.IE.value = 0;
+    b.regs.IFG.value = 0;
+}
+
+static void writeCtlw0( uint8_t m, uint16_t value )
+{
+    SimBus & b = buses[m];
+    uint16_t old = b.regs.CTLW0.value;
+
+    // UCTXSTT and UCTXSTP are only ever cleared by the hardware
+    value |= old & (EUSCI_B_CTLW0_TXSTT | EUSCI_B_CTLW0_TXSTP);
+    b.regs.CTLW0.value = value;
+
+    if (value & EUSCI_B_CTLW0_SWRST)
+    {
+        if (!(old & EUSCI_B_CTLW0_SWRST) || b.state != M_IDLE)
+        {
+            moduleReset( m );
+        }
+        b.regs.CTLW0.value &= ~(EUSCI_B_CTLW0_TXSTT | EUSCI_B_CTLW0_TXSTP);
+        return;
+    }
+
+    if (!(value & EUSCI_B_CTLW0_MST))
+        return;
+
+    if ((value & EUSCI_B_CTLW0_TXSTT) && !(old & EUSCI_B_CTLW0_TXSTT))
+    {
+        if (b.state == M_IDLE || b.state == M_HOLD_TX || b.state == M_HOLD_NACK)
+        {
+            masterStart( m );
+        }
+    }
+
+    if ((value & EUSCI_B_CTLW0_TXSTP) && !(old & EUSCI_B_CTLW0_TXSTP))
+    {
+        if (b.state == M_HOLD_TX || b.state == M_HOLD_NACK)
+        {
+            masterStop( m );
+        }
+        else if (b.state == M_IDLE)
+        {
+            b.regs.CTLW0.value &= ~EUSCI_B_CTLW0_TXSTP;
+        }
+    }
+}
+
+static void writeTxbuf( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.regs.IFG.value &= ~TXIFG_ALL;
+    b.txFull = true;
+
+    if ((b.regs.CTLW0.value & EUSCI_B_CTLW0_MST) && b.state == M_HOLD_TX)
+    {
+        masterShift( m );
+    }
+}
+
+/**** Register access, from the CPU or the DMA controller ****/
+
+static uint16_t peripheralRead( const SimRegister16 * r )
+{
+    SimBus & b = buses[r->module];
+
+    if (r->offset == REG_RXBUF)
+    {
+        b.regs.IFG.value &= ~RXIFG_ALL;
+        if (b.state == M_RX_STALL)
+        {
+            schedule( r->module, cycles, busEvent, r->module );
+        }
+    }
+    return r->value;
+}
+
+static void peripheralWrite( SimRegister16 * r, uint16_t value )
+{
+    switch (r->offset)
+    {
+        case REG_CTLW0:
+            writeCtlw0( r->module, value );
+            break;
+
+        case REG_TXBUF:
+            r->value = value & 0xFF;
+            writeTxbuf( r->module );
+            break;
+
+        case REG_RXBUF:
+        case REG_STATW:
+            // read-only
+            break;
+
+        default:
+            r->value = value;
+            break;
+    }
+    dmaService( );
+}
+
+/**** uDMA controller ****/
+
+/**
+ * Map an address handed to the DMA controller onto an eUSCI_B register
+ */
+static SimRegister16 * registerAt( void * address )
+{
+    for (int m = 0; m < I2CSIM_BUSES; m++)
+    {
+        uint8_t * base = (uint8_t *) &buses[m].regs;
+        if ((uint8_t *) address >= base && (uint8_t *) address < base + sizeof(EUSCI_B_Type))
+        {
+            return (SimRegister16 *) base + ((uint8_t *) address - base) / sizeof(SimRegister16);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Move one byte for a channel in basic mode
+ */
+static void dmaTransfer( I2CSim::DmaChannel & ch )
+{
+    SimRegister16 * from = registerAt( ch.src );
+    SimRegister16 * to = registerAt( ch.dst );
+
+    uint8_t value = from ? (uint8_t) peripheralRead( from ) : *ch.src;
+    if (to)
+    {
+        peripheralWrite( to, value );
+    }
+    else
+    {
+        *ch.dst = value;
+    }
+
+    if ((ch.control & UDMA_SRC_INC_NONE) != UDMA_SRC_INC_NONE)
+    {
+        ch.src++;
+    }
+    if ((ch.control & UDMA_DST_INC_NONE) != UDMA_DST_INC_NONE)
+    {
+        ch.dst++;
+    }
+    if (!--ch.remaining)
+    {
+        ch.enabled = false;
+    }
+}
+
+/**
+ * Serve every enabled channel whose eUSCI_B trigger is raised. The
+ * transfer itself clears the trigger, as the DMA accesses TXBUF or RXBUF.
+ */
+static void dmaService( void )
+{
+    static bool active;
+
+    if (active)
+        return;
+
+    active = true;
+    for (bool moved = true; moved;)
+    {
+        moved = false;
+        for (uint8_t c = 0; c < I2CSIM_DMA_CHANNELS; c++)
+        {
+            I2CSim::DmaChannel & ch = dma[c];
+            if (!ch.enabled || ch.source != DMA_SOURCE_EUSCIB)
+                continue;
+
+            // even channels take TX0 of eUSCI_B(c / 2), odd channels RX0
+            uint16_t trigger = (c & 1) ? EUSCI_B_IFG_RXIFG0 : EUSCI_B_IFG_TXIFG0;
+            if (buses[c >> 1].regs.IFG.value & trigger)
+            {
+                dmaTransfer( ch );
+                moved = true;
+            }
+        }
+    }
+    active = false;
+}
+
+/**** Timer32 ****/
+
+static uint32_t timerShift( const I2CSim::Timer32 & t )
+{
+    switch (t.control & TIMER32_CONTROL_PRESCALE_MASK)
+    {
+        case TIMER32_PRESCALER_16:
+            return 4;
+
+        case TIMER32_PRESCALER_256:
+            return 8;
+    }
+    return 0;
+}
+
+static uint32_t timerValue( const I2CSim::Timer32 & t )
+{
+    if (!(t.control & TIMER32_CONTROL_ENABLE))
+        return t.count;
+
+    uint64_t ticks = (cycles - t.since) >> timerShift( t );
+    if (ticks <= t.count)
+        return t.count - (uint32_t) ticks;
+
+    // a one-shot counter halts at zero, the others wrap around
+    if (t.control & TIMER32_CONTROL_ONESHOT)
+        return 0;
+
+    uint64_t period = (t.control & TIMER32_PERIODIC_MODE) ? (uint64_t) t.load + 1
+            : (t.control & TIMER32_32BIT) ? 0x100000000ULL : 0x10000;
+    return (uint32_t) (period - 1 - (ticks - t.count - 1) % period);
+}
+
+static void timerEvent( uint8_t );
+
+/**
+ * Schedule the moment the counter reaches zero
+ */
+static void timerSchedule( uint8_t n )
+{
+    I2CSim::Timer32 & t = timers[n];
+
+    events[TIMER_SLOT( n )].armed = false;
+    if (!(t.control & TIMER32_CONTROL_ENABLE)
+            || (!t.count && (t.control & TIMER32_CONTROL_ONESHOT)))
+        return;
+
+    schedule( TIMER_SLOT( n ), t.since + ((uint64_t) t.count << timerShift( t )),
+            timerEvent, n );
+}
+
+static void timerEvent( uint8_t n )
+{
+    I2CSim::Timer32 & t = timers[n];
+
+    t.pending = true;
+    t.since = cycles;
+    if (t.control & TIMER32_CONTROL_ONESHOT)
+    {
+        t.count = 0;
+    }
+    else
+    {
+        t.count = (t.control & TIMER32_PERIODIC_MODE) ? t.load
+                : (t.control & TIMER32_32BIT) ? 0xFFFFFFFF : 0xFFFF;
+    }
+    timerSchedule( n );
+}
+
+/**** Slave side: driven by the virtual master ****/
+
+static int ownAddress( SimBus & b, uint8_t address )
+{
+    if (b.regs.CTLW0.value & (EUSCI_B_CTLW0_SWRST | EUSCI_B_CTLW0_MST))
+        return -1;
+
+    SimRegister16 * ownAddresses = &b.regs.I2COA0;
+    for (int n = 0; n < 4; n++)
+    {
+        uint16_t oa = ownAddresses[n].value;
+        if ((oa & EUSCI_B_I2COA0_OAEN) && (oa & 0x3FF) == address)
+            return n;
+    }
+    return -1;
+}
+
+static bool rxFree( SimBus & b )
+{
+    return !(b.regs.IFG.value & RXIFG_ALL);
+}
+
+static bool txLoaded( SimBus & b )
+{
+    return b.txFull;
+}
+
+/**
+ * Stretch the clock until the slave is ready, or until the clock low
+ * timeout of the module expires
+ */
+static bool stretch( uint8_t m, bool (*ready)( SimBus & ) )
+{
+    SimBus & b = buses[m];
+    uint64_t limit = ~0ULL;
+
+    switch (b.regs.CTLW1.value & EUSCI_B_CTLW1_CLTO_MASK)
+    {
+        case EUSCI_B_CTLW1_CLTO_1:
+            limit = cycles + (uint64_t) mclk * 28 / 1000;
+            break;
+
+        case EUSCI_B_CTLW1_CLTO_2:
+            limit = cycles + (uint64_t) mclk * 31 / 1000;
+            break;
+
+        case EUSCI_B_CTLW1_CLTO_3:
+            limit = cycles + (uint64_t) mclk * 34 / 1000;
+            break;
+    }
+
+    while (!ready( b ))
+    {
+        int e = nextEvent( );
+        if (e >= 0 && events[e].at <= limit)
+        {
+            fire( e, false );
+            dispatch( );
+            continue;
+        }
+
+        // nothing can release SCL anymore
+        if (limit != ~0ULL)
+        {
+            cycles = limit;
+            b.regs.IFG.value |= EUSCI_B_IFG_CLTOIFG;
+            dispatch( );
+        }
+        b.regs.STATW.value &= ~EUSCI_B_STATW_BBUSY;
+        b.stats.busyCycles += cycles - b.busyFrom;
+        return false;
+    }
+    return true;
+}
+
+static int slaveAddress( uint8_t m, uint8_t address, bool read )
+{
+    SimBus & b = buses[m];
+    uint32_t bit = mclk / b.masterRate;
+
+    b.busyFrom = cycles;
+    b.stats.starts++;
+    elapse( 10 * bit );
+
+    int n = ownAddress( b, address );
+    if (n < 0)
+    {
+        b.stats.naks++;
+        elapse( bit );
+        b.stats.busyCycles += cycles - b.busyFrom;
+        return -1;
+    }
+
+    b.regs.ADDRX.value = address;
+    b.regs.STATW.value |= EUSCI_B_STATW_BBUSY;
+    if (read)
+    {
+        b.regs.CTLW0.value |= EUSCI_B_CTLW0_TR;
+        b.regs.IFG.value |= EUSCI_B_IFG_STTIFG | txFlag[n];
+    }
+    else
+    {
+        b.regs.CTLW0.value &= ~EUSCI_B_CTLW0_TR;
+        b.regs.IFG.value |= EUSCI_B_IFG_STTIFG;
+    }
+    dispatch( );
+    return n;
+}
+
+static void slaveStop( uint8_t m )
+{
+    SimBus & b = buses[m];
+
+    b.stats.stops++;
+    elapse( mclk / b.masterRate );
+    b.regs.IFG.value |= EUSCI_B_IFG_STPIFG;
+    b.regs.STATW.value &= ~EUSCI_B_STATW_BBUSY;
+    b.stats.busyCycles += cycles - b.busyFrom;
+    dispatch( );
+}
+
+/**** PUBLIC METHODS ****/
+
+void I2CSim::reset( void )
+{
+    memset( (void *) buses, 0, sizeof(buses) );
+    memset( events, 0, sizeof(events) );
+    memset( dma, 0, sizeof(dma) );
+    memset( timers, 0, sizeof(timers) );
+    memset( vectors, 0, sizeof(vectors) );
+    memset( nvicEnabled, 0, sizeof(nvicEnabled) );
+    memset( portOut, 0, sizeof(portOut) );
+    memset( portDir, 0, sizeof(portDir) );
+    memset( portSel, 0, sizeof(portSel) );
+
+    for (uint8_t m = 0; m < I2CSIM_BUSES; m++)
+    {
+        SimRegister16 * r = (SimRegister16 *) &buses[m].regs;
+        for (uint8_t i = 0; i < sizeof(EUSCI_B_Type) / sizeof(SimRegister16); i++)
+        {
+            r[i].module = m;
+            r[i].offset = i;
+        }
+        buses[m].regs.CTLW0.value = EUSCI_B_CTLW0_SWRST | EUSCI_B_CTLW0_SYNC
+                | EUSCI_B_CTLW0_SSEL_MASK;
+        buses[m].masterRate = 400000;
+    }
+
+    interruptsEnabled = true;
+    cycles = 0;
+    mclk = 48000000;
+    smclk = 12000000;
+    autoRun = true;
+    isrDepth = 0;
+    isrBus = -1;
+    callDepth = 0;
+    resets = 0;
+    initialised = true;
+}
+
+void I2CSim::setClocks( uint32_t newMclk, uint32_t newSmclk )
+{
+    initialise( );
+    mclk = newMclk;
+    smclk = newSmclk;
+}
+
+void I2CSim::setAutoRun( bool enable )
+{
+    initialise( );
+    autoRun = enable;
+}
+
+/**
+ * Let a slave hold SDA low for the given number of SCL pulses, as one
+ * that was cut off in the middle of a byte it was sending. Until then
+ * no START can be generated on the bus. A blocking DWire call sees its
+ * timeout expire either way: sleeping lets the time pass until the timer
+ * interrupt, and a polling wait reads the Timer32 on every round
+ */
+void I2CSim::holdSda( uint8_t bus, uint8_t pulses )
+{
+    initialise( );
+    buses[bus].sdaHeld = pulses;
+}
+
+/**
+ * Let another master win the arbitration against the next START on the
+ * bus, during its address byte
+ */
+void I2CSim::loseArbitration( uint8_t bus )
+{
+    initialise( );
+    buses[bus].loseNext = true;
+}
+
+void I2CSim::attach( uint8_t bus, I2CSimDevice * device )
+{
+    initialise( );
+    for (int i = 0; i < I2CSIM_DEVICES; i++)
+    {
+        if (!buses[bus].devices[i])
+        {
+            buses[bus].devices[i] = device;
+            return;
+        }
+    }
+}
+
+void I2CSim::detach( uint8_t bus, I2CSimDevice * device )
+{
+    for (int i = 0; i < I2CSIM_DEVICES; i++)
+    {
+        if (buses[bus].devices[i] == device)
+        {
+            buses[bus].devices[i] = 0;
+        }
+    }
+}
+
+uint64_t I2CSim::now( void )
+{
+    return cycles;
+}
+
+/**
+ * Keep the CPU busy with other work for the given number of cycles,
+ * while the bus and the interrupts keep running
+ */
+void I2CSim::advance( uint64_t delta )
+{
+    uint64_t until = cycles + delta;
+    run( until, false );
+    if (cycles < until)
+    {
+        cycles = until;
+    }
+}
+
+uint32_t I2CSim::bitCycles( uint8_t bus )
+{
+    return bitTime( buses[bus] );
+}
+
+const I2CSim::Stats & I2CSim::stats( uint8_t bus )
+{
+    return buses[bus].stats;
+}
+
+void I2CSim::clearStats( void )
+{
+    for (int m = 0; m < I2CSIM_BUSES; m++)
+    {
+        memset( &buses[m].stats, 0, sizeof(Stats) );
+        buses[m].hadStop = false;
+    }
+}
+
+uint32_t I2CSim::hardResets( void )
+{
+    return resets;
+}
+
+void I2CSim::setMasterRate( uint8_t bus, uint32_t rate )
+{
+    initialise( );
+    buses[bus].masterRate = rate;
+}
+
+/**
+ * Write to a DWire slave as a master. Returns the number of bytes ACKed,
+ * -1 if the address was not ACKed, -2 if the slave stretched the clock
+ * until the transfer had to be abandoned
+ */
+int I2CSim::masterWrite( uint8_t bus, uint8_t address, const uint8_t * data,
+        uint16_t length, bool stop )
+{
+    SimBus & b = buses[bus];
+    uint32_t bit = mclk / b.masterRate;
+
+    int n = slaveAddress( bus, address, false );
+    if (n < 0)
+        return -1;
+
+    int acked = 0;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (!stretch( bus, rxFree ))
+            return -2;
+
+        elapse( 9 * bit );
+        b.stats.bytesTx++;
+        if (b.regs.CTLW0.value & EUSCI_B_CTLW0_TXNACK)
+        {
+            b.regs.CTLW0.value &= ~EUSCI_B_CTLW0_TXNACK;
+            b.stats.naks++;
+            break;
+        }
+        b.regs.RXBUF.value = data[i];
+        b.regs.IFG.value |= rxFlag[n];
+        dispatch( );
+        acked++;
+    }
+
+    if (stop)
+    {
+        slaveStop( bus );
+    }
+    return acked;
+}
+
+/**
+ * Read from a DWire slave as a master. Returns the number of bytes read,
+ * -1 if the address was not ACKed, -2 if the slave stretched the clock
+ * until the transfer had to be abandoned
+ */
+int I2CSim::masterRead( uint8_t bus, uint8_t address, uint8_t * data,
+        uint16_t length, bool stop )
+{
+    SimBus & b = buses[bus];
+    uint32_t bit = mclk / b.masterRate;
+
+    int n = slaveAddress( bus, address, true );
+    if (n < 0)
+        return -1;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (!stretch( bus, txLoaded ))
+            return -2;
+
+        // the transmitter asks for the next byte as soon as this one is shifted out
+        b.shift = (uint8_t) b.regs.TXBUF.value;
+        b.txFull = false;
+        b.regs.IFG.value |= txFlag[n];
+        dispatch( );
+
+        elapse( 9 * bit );
+        b.stats.bytesRx++;
+        data[i] = b.shift;
+    }
+
+    // the last byte was NAKed by the master: drop anything preloaded
+    b.txFull = false;
+    b.regs.IFG.value &= ~TXIFG_ALL;
+
+    if (stop)
+    {
+        slaveStop( bus );
+    }
+    return length;
+}
+
+/**** Internal: driverlib shim support ****/
+
+EUSCI_B_Type * I2CSim::_registers( uint32_t base )
+{
+    initialise( );
+
+    uint32_t m = (base - EUSCI_B0_BASE) >> 10;
+    if (base < EUSCI_B0_BASE || m >= I2CSIM_BUSES)
+    {
+        fprintf( stderr, "I2CSim: 0x%08X is not an eUSCI_B module\n", base );
+        abort( );
+    }
+    return &buses[m].regs;
+}
+
+uint16_t I2CSim::_readRegister( const SimRegister16 * r )
+{
+    _charge( REGISTER_ACCESS_CYCLES );
+    uint16_t value = peripheralRead( r );
+
+    if (!callDepth)
+    {
+        service( );
+    }
+    return value;
+}
+
+void I2CSim::_writeRegister( SimRegister16 * r, uint16_t value )
+{
+    _charge( REGISTER_ACCESS_CYCLES );
+    peripheralWrite( r, value );
+
+    if (!callDepth)
+    {
+        service( );
+    }
+}
+
+/**
+ * Charge CPU cycles to the current context
+ */
+void I2CSim::_charge( uint32_t delta )
+{
+    cycles += delta;
+    if (isrBus >= 0)
+    {
+        buses[isrBus].stats.isrCycles += delta;
+    }
+}
+
+/**
+ * Called by the shim when a driverlib call is entered
+ */
+void I2CSim::_enterCall( void )
+{
+    _charge( DRIVERLIB_CALL_CYCLES );
+    callDepth++;
+}
+
+/**
+ * Called by the shim when a driverlib call returns
+ */
+void I2CSim::_leaveCall( void )
+{
+    callDepth--;
+    if (!callDepth)
+    {
+        service( );
+    }
+}
+
+/**
+ * Busy wait inside a driverlib call until the given flag is raised
+ */
+/**
+ * A read of the DWT cycle counter
+ */
+uint32_t I2CSim::_cycleCounter( void )
+{
+    _charge( REGISTER_ACCESS_CYCLES );
+    uint32_t value = (uint32_t) cycles;
+
+    if (!callDepth)
+    {
+        service( );
+    }
+    return value;
+}
+
+/**
+ * Poll for a flag of a bus, at most the given number of rounds; without a
+ * limit, the hardware would hang once nothing is going to happen anymore
+ */
+void I2CSim::_waitFlag( uint8_t bus, uint16_t flag, uint32_t rounds )
+{
+    uint64_t end = rounds == 0xFFFFFFFF ? ~0ULL
+            : cycles + (uint64_t) rounds * POLL_LOOP_CYCLES;
+
+    while (!(buses[bus].regs.IFG.value & flag))
+    {
+        int e = nextEvent( );
+        if (e < 0)
+            return;
+
+        if (events[e].at > end)
+        {
+            if (!isrDepth)
+            {
+                buses[bus].stats.waitCycles += end - cycles;
+            }
+            cycles = end;
+            return;
+        }
+
+        fire( e, !isrDepth );
+        dispatch( );
+    }
+}
+
+I2CSim::DmaChannel * I2CSim::_dmaChannel( uint8_t channel )
+{
+    initialise( );
+    return &dma[channel % I2CSIM_DMA_CHANNELS];
+}
+
+/**
+ * Called by the shim after a channel has been reconfigured or enabled
+ */
+void I2CSim::_dmaUpdate( void )
+{
+    dmaService( );
+}
+
+I2CSim::Timer32 * I2CSim::_timer32( uint32_t base )
+{
+    initialise( );
+
+    uint32_t n = (base - TIMER32_0_BASE) / (TIMER32_1_BASE - TIMER32_0_BASE);
+    if (base < TIMER32_0_BASE || n >= I2CSIM_TIMERS)
+    {
+        fprintf( stderr, "I2CSim: 0x%08X is not a Timer32 module\n", base );
+        abort( );
+    }
+    return &timers[n];
+}
+
+uint32_t I2CSim::_timer32Value( Timer32 * t )
+{
+    return timerValue( *t );
+}
+
+/**
+ * Write the control register: the counter carries on from its value
+ */
+void I2CSim::_timer32Control( Timer32 * t, uint32_t control )
+{
+    t->count = timerValue( *t );
+    t->since = cycles;
+    t->control = control;
+    timerSchedule( (uint8_t) (t - timers) );
+}
+
+/**
+ * Write the load register, which also loads the counter
+ */
+void I2CSim::_timer32Load( Timer32 * t, uint32_t load )
+{
+    t->load = (t->control & TIMER32_32BIT) ? load : load & 0xFFFF;
+    t->count = t->load;
+    t->since = cycles;
+    timerSchedule( (uint8_t) (t - timers) );
+}
+
+void I2CSim::_registerInterrupt( uint32_t interrupt, void (*handler)( void ) )
+{
+    if (interrupt < VECTORS)
+    {
+        vectors[interrupt] = handler;
+    }
+}
+
+void I2CSim::_enableInterrupt( uint32_t interrupt, bool enable )
+{
+    if (interrupt < VECTORS)
+    {
+        nvicEnabled[interrupt] = enable;
+    }
+}
+
+bool I2CSim::_isInterruptEnabled( uint32_t interrupt )
+{
+    return interrupt < VECTORS && nvicEnabled[interrupt];
+}
+
+/**
+ * Returns true if interrupts were disabled before the call
+ */
+bool I2CSim::_enableMaster( bool enable )
+{
+    bool wasDisabled = !interruptsEnabled;
+    interruptsEnabled = enable;
+    return wasDisabled;
+}
+
+/**
+ * WFI: sleep until an interrupt is pending, also while they are disabled,
+ * and wake up again. Nothing is charged if one is pending already
+ */
+bool I2CSim::_sleep( void )
+{
+    if (pendingInterrupt( ) >= 0)
+        return true;
+
+    while (pendingInterrupt( ) < 0)
+    {
+        int e = nextEvent( );
+        if (e < 0)
+        {
+            fprintf( stderr, "I2CSim: sleeping with no interrupt to come\n" );
+            abort( );
+        }
+
+        if (e < I2CSIM_BUSES && events[e].at > cycles)
+        {
+            buses[e].stats.sleepCycles += events[e].at - cycles;
+        }
+        fire( e, true );
+    }
+
+    _charge( WAKEUP_CYCLES );
+    return true;
+}
+
+void I2CSim::_gpio( uint_fast8_t port, uint_fast16_t pins, uint8_t operation )
+{
+    if (port > 10)
+        return;
+
+    switch (operation)
+    {
+        case GPIO_OP_PERIPHERAL:
+            portSel[port] |= pins;
+            portDir[port] &= ~pins;
+            break;
+
+        case GPIO_OP_OUTPUT:
+            portSel[port] &= ~pins;
+            portDir[port] |= pins;
+            break;
+
+        case GPIO_OP_INPUT:
+            portSel[port] &= ~pins;
+            portDir[port] &= ~pins;
+            break;
+
+        case GPIO_OP_LOW:
+            portOut[port] &= ~pins;
+            break;
+
+        case GPIO_OP_HIGH:
+            portOut[port] |= pins;
+            break;
+    }
+
+    // follow the SCL and SDA lines of every bus on this port, counting
+    // clock pulses and STOP conditions
+    for (int m = 0; m < I2CSIM_BUSES; m++)
+    {
+        if (busPort[m] != port)
+            continue;
+
+        SimBus & b = buses[m];
+        uint8_t scl = busScl[m];
+        uint8_t sda = busSda[m];
+        bool low = !(portSel[port] & scl) && (portDir[port] & scl) && !(portOut[port] & scl);
+        if (b.sclLow && !low)
+        {
+            b.stats.sclPulses++;
+            if (b.sdaHeld)
+            {
+                b.sdaHeld--;
+            }
+        }
+        b.sclLow = low;
+
+        low = !(portSel[port] & sda) && (portDir[port] & sda) && !(portOut[port] & sda);
+        if (b.sdaLow && !low && !b.sclLow && !b.sdaHeld)
+        {
+            b.stats.stops++;
+        }
+        b.sdaLow = low;
+    }
+}
+
+uint8_t I2CSim::_gpioInput( uint_fast8_t port, uint_fast16_t pins )
+{
+    if (port > 10)
+        return GPIO_INPUT_PIN_LOW;
+
+    // pins driven low by the port itself or by a stuck slave read low, the
+    // rest is pulled up
+    uint8_t low = portDir[port] & ~portSel[port] & ~portOut[port] & pins;
+    for (int m = 0; m < I2CSIM_BUSES; m++)
+    {
+        if (busPort[m] == port && buses[m].sdaHeld)
+        {
+            low |= busSda[m] & pins;
+        }
+    }
+    return low ? GPIO_INPUT_PIN_LOW : GPIO_INPUT_PIN_HIGH;
+}
+
+void I2CSim::_hardReset( void )
+{
+    resets++;
+}
+
+uint32_t I2CSim::_mclk( void )
+{
+    return mclk;
+}
+
+uint32_t I2CSim::_smclk( void )
+{
+    return smclk;
+}
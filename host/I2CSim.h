@@ -0,0 +1,145 @@
+/*
+ * DWire host simulation: eUSCI_B bus model.
+ *
+ * Models the four eUSCI_B modules of the MSP432 in I2C mode, the bus
+ * attached to each of them and the NVIC lines that invoke the registered
+ * EUSCIBx_IRQHandler_I2C handlers, plus the uDMA channels that can be
+ * triggered by the eUSCI_B modules and the two Timer32 counters. Time
+ * is counted in MCLK cycles:
+ * bus activity is derived from the programmed bit rate (UCBxBRW), CPU
+ * activity from a simple cost model (exception entry/exit, driverlib
+ * calls, peripheral register accesses). Plain C++ logic is not charged.
+ *
+ * By default every driverlib call made outside interrupt context runs
+ * the simulation until the bus is quiescent again. This lets the busy
+ * wait loops of the blocking DWire API see the completed transfer. A
+ * Timer32 that runs beyond that point does not hold it up, it fires
+ * once the simulation has got there. PCM_gotoLPM0 lets time pass until
+ * an interrupt is pending and charges the wake-up latency. With
+ * setAutoRun( false ) the bus only advances by the CPU time charged to
+ * driverlib calls and register accesses, and by advance( ), which models
+ * the application doing other work (e.g. with the asynchronous API).
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_HOST_I2CSIM_H_
+#define DWIRE_HOST_I2CSIM_H_
+
+#include <driverlib.h>
+#include "I2CSimDevice.h"
+
+#define I2CSIM_BUSES 4
+#define I2CSIM_DEVICES 16
+#define I2CSIM_DMA_CHANNELS 8
+#define I2CSIM_TIMERS 2
+
+class I2CSim
+{
+public:
+    /* Per-bus counters, all times in MCLK cycles */
+    struct Stats
+    {
+        uint32_t starts;            // START conditions issued by the master
+        uint32_t restarts;          // of which repeated STARTs
+        uint32_t stops;             // also those generated through GPIO
+        uint32_t bytesTx;           // data bytes written by the master
+        uint32_t bytesRx;           // data bytes read by the master
+        uint32_t naks;              // address and data NAKs
+        uint64_t busyCycles;        // from START to the end of STOP
+        uint64_t gapCycles;         // idle time between STOP and next START
+        uint32_t gaps;
+        uint32_t isrEntries;
+        uint64_t isrCycles;         // CPU time spent in the I2C handler
+        uint64_t waitCycles;        // CPU time blocked in the DWire API
+        uint64_t sleepCycles;       // of which asleep in LPM0
+        uint32_t sclPulses;         // SCL pulses generated through GPIO
+    };
+
+    /* uDMA channel, in basic mode; set up through the DMA_ shim */
+    struct DmaChannel
+    {
+        uint8_t source;             // trigger selected by DMA_assignChannel
+        bool enabled;
+        uint32_t control;
+        uint8_t * src;
+        uint8_t * dst;
+        uint32_t remaining;         // transfers left
+    };
+
+    /* Timer32 counter, set up through the Timer32_ shim */
+    struct Timer32
+    {
+        uint32_t control;           // TIMER32_CONTROL_... and mode bits
+        uint32_t load;
+        bool pending;               // raw interrupt status
+        uint32_t count;             // value when last loaded or (re)started
+        uint64_t since;
+    };
+
+    /* Cost model, in MCLK cycles */
+    static const uint32_t ISR_OVERHEAD_CYCLES = 24;
+    static const uint32_t DRIVERLIB_CALL_CYCLES = 20;
+    static const uint32_t REGISTER_ACCESS_CYCLES = 3;
+    static const uint32_t NOP_LOOP_CYCLES = 10;
+    static const uint32_t POLL_LOOP_CYCLES = 6;     // per round of a driverlib poll
+    static const uint32_t WAKEUP_CYCLES = 24;   // from LPM0 to running again
+
+    static void reset( void );
+    static void setClocks( uint32_t, uint32_t );
+    static void setAutoRun( bool );
+
+    static void attach( uint8_t, I2CSimDevice * );
+    static void detach( uint8_t, I2CSimDevice * );
+
+    static uint64_t now( void );
+    static void advance( uint64_t );
+
+    static uint32_t bitCycles( uint8_t );
+    static const Stats & stats( uint8_t );
+    static void clearStats( void );
+    static uint32_t hardResets( void );
+    static void holdSda( uint8_t, uint8_t );
+    static void loseArbitration( uint8_t );
+
+    /* Virtual bus master, to exercise DWire in slave mode */
+    static void setMasterRate( uint8_t, uint32_t );
+    static int masterWrite( uint8_t, uint8_t, const uint8_t *, uint16_t, bool = true );
+    static int masterRead( uint8_t, uint8_t, uint8_t *, uint16_t, bool = true );
+
+    /* Internal: used by the driverlib shim */
+    static EUSCI_B_Type * _registers( uint32_t );
+    static uint16_t _readRegister( const SimRegister16 * );
+    static void _writeRegister( SimRegister16 *, uint16_t );
+    enum
+    {
+        GPIO_OP_PERIPHERAL, GPIO_OP_OUTPUT, GPIO_OP_INPUT, GPIO_OP_LOW, GPIO_OP_HIGH
+    };
+
+    static void _charge( uint32_t );
+    static void _enterCall( void );
+    static void _leaveCall( void );
+    static void _waitFlag( uint8_t, uint16_t, uint32_t = 0xFFFFFFFF );
+    static uint32_t _cycleCounter( void );
+    static DmaChannel * _dmaChannel( uint8_t );
+    static void _dmaUpdate( void );
+    static Timer32 * _timer32( uint32_t );
+    static uint32_t _timer32Value( Timer32 * );
+    static void _timer32Control( Timer32 *, uint32_t );
+    static void _timer32Load( Timer32 *, uint32_t );
+    static void _registerInterrupt( uint32_t, void (*)( void ) );
+    static void _enableInterrupt( uint32_t, bool );
+    static bool _isInterruptEnabled( uint32_t );
+    static bool _enableMaster( bool );
+    static bool _sleep( void );
+    static void _gpio( uint_fast8_t, uint_fast16_t, uint8_t );
+    static uint8_t _gpioInput( uint_fast8_t, uint_fast16_t );
+    static void _hardReset( void );
+    static uint32_t _mclk( void );
+    static uint32_t _smclk( void );
+};
+
+#endif /* DWIRE_HOST_I2CSIM_H_ */
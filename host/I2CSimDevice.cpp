@@ -0,0 +1,61 @@
+/*
+ * DWire host simulation: virtual I2C slave devices.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "I2CSimDevice.h"
+
+I2CSimMemory::I2CSimMemory( uint8_t address, uint8_t * memory, uint32_t size,
+        uint8_t pointerBytes ) :
+        I2CSimDevice( address )
+{
+    this->memory = memory;
+    this->size = size;
+    this->pointerBytes = pointerBytes;
+    pointer = 0;
+    pointerIndex = 0;
+    nakRate = 0;
+    seed = 0x2545F491;
+}
+
+bool I2CSimMemory::onAddress( bool read )
+{
+    // a write always starts with the new pointer value
+    pointerIndex = read ? pointerBytes : 0;
+
+    if (!nakRate)
+        return true;
+
+    // deterministic pseudo-random NAKs, so benchmark runs are repeatable
+    seed = seed * 1103515245 + 12345;
+    return ((seed >> 16) % 1000) >= nakRate;
+}
+
+bool I2CSimMemory::onWrite( uint8_t data )
+{
+    if (pointerIndex < pointerBytes)
+    {
+        if (!pointerIndex)
+        {
+            pointer = 0;
+        }
+        pointer = (pointer << 8) | data;
+        pointerIndex++;
+        return true;
+    }
+
+    memory[pointer % size] = data;
+    pointer++;
+    return true;
+}
+
+uint8_t I2CSimMemory::onRead( void )
+{
+    uint8_t data = memory[pointer % size];
+    pointer++;
+    return data;
+}
@@ -0,0 +1,68 @@
+/*
+ * DWire host simulation: virtual I2C slave devices.
+ *
+ * A device is attached to one of the four simulated eUSCI_B buses and is
+ * called by the bus model whenever a DWire master addresses it. The
+ * return values decide whether the address and data bytes are ACKed.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_HOST_I2CSIMDEVICE_H_
+#define DWIRE_HOST_I2CSIMDEVICE_H_
+
+#include <stdint.h>
+
+class I2CSimDevice
+{
+public:
+    I2CSimDevice( uint8_t address ) : address( address ) { }
+    virtual ~I2CSimDevice( ) { }
+
+    /* Called on every (repeated) START addressed to this device, return false to NAK */
+    virtual bool onAddress( bool read ) { return true; }
+
+    /* Called for every byte written by the master, return false to NAK */
+    virtual bool onWrite( uint8_t ) { return true; }
+
+    /* Called for every byte read by the master */
+    virtual uint8_t onRead( void ) { return 0xFF; }
+
+    /* Called when the master ends the transaction */
+    virtual void onStop( void ) { }
+
+    uint8_t address;
+};
+
+/**
+ * A register-pointer device, behaving like most sensors and EEPROMs:
+ * the first byte(s) of a write set the pointer, further bytes are stored,
+ * reads return the memory contents. The pointer auto-increments.
+ */
+class I2CSimMemory : public I2CSimDevice
+{
+public:
+    I2CSimMemory( uint8_t address, uint8_t * memory, uint32_t size, uint8_t pointerBytes = 1 );
+
+    /* NAK a fraction of the address phases, in parts per thousand */
+    void setNakRate( uint16_t perMille ) { nakRate = perMille; }
+
+    virtual bool onAddress( bool read );
+    virtual bool onWrite( uint8_t );
+    virtual uint8_t onRead( void );
+
+    uint32_t pointer;
+
+private:
+    uint8_t * memory;
+    uint32_t size;
+    uint8_t pointerBytes;
+    uint8_t pointerIndex;
+    uint16_t nakRate;
+    uint32_t seed;
+};
+
+#endif /* DWIRE_HOST_I2CSIMDEVICE_H_ */
@@ -0,0 +1,354 @@
+/*
+ * DWire host simulation: throughput benchmark.
+ *
+ * Sweeps payload size, data rate and NAK rate over the blocking master
+ * API and prints one CSV row per configuration:
+ *
+ *   op              operation under test
+ *   speed           STANDARD, FAST or FASTPLUS
+ *   bytes           payload bytes per transaction
+ *   nak_permille    injected address NAK rate
+ *   transactions    transactions attempted
+ *   completed       transactions that succeeded
+ *   throughput_Bps  payload bytes per second of elapsed time
+ *   isr_cycles_per_byte   CPU cycles in the I2C handler per payload byte
+ *   wait_us_per_txn time blocked in the DWire API per transaction
+ *   bus_utilisation fraction of the elapsed time the bus was busy
+ *   gap_us          mean idle time between two transactions
+ *   sleep_us_per_txn      time asleep in LPM0 per transaction
+ *
+ * The write-dma and read-dma rows repeat the operations with the data
+ * moved by the uDMA controller (DWire::enableDMA), the write-async and
+ * read-async rows use the asynchronous API while the CPU keeps working and
+ * the write-queue and read-queue rows keep the transaction queue filled.
+ * The write-read rows read a register with endTransmission(false) and
+ * requestFrom, the read-register rows with a combined transfer. The
+ * write-sleep and read-sleep rows repeat write and read with the CPU
+ * asleep while it waits (DWire::enableLowPower). The
+ * write-stream and read-stream rows move the payload of 32 transactions
+ * of 255 bytes in a single streaming transfer.
+ *
+ * Run without arguments for a coarse sweep, with "all" to sweep every
+ * payload size from 1 to 255 bytes.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <DWire.h>
+
+#include "I2CSim.h"
+
+#define DEVICE_ADDRESS 0x48
+#define TRANSACTIONS 32
+#define BUS 1
+#define WORK_CYCLES 48
+
+DWire wire( BUS );
+
+uint8_t memory[256];
+I2CSimMemory device( DEVICE_ADDRESS, memory, sizeof(memory) );
+
+uint8_t payload[255];
+uint8_t responses[TRANSACTION_QUEUE_SIZE][255];
+DWireTransaction transactions[TRANSACTION_QUEUE_SIZE];
+uint32_t queueCompleted;
+
+static const char * speedNames[] = { "STANDARD", "FAST", "FASTPLUS" };
+static const uint16_t nakRates[] = { 0, 10, 100 };
+static const uint8_t coarseSizes[] = { 1, 2, 4, 8, 16, 32, 64, 128, 255 };
+
+typedef bool (*Operation)( uint32_t );
+
+/**
+ * Write a register pointer followed by the payload; returns true on success
+ */
+static bool opWrite( uint32_t bytes )
+{
+    wire.beginTransmission( DEVICE_ADDRESS );
+    for (uint16_t i = 0; i < bytes; i++)
+    {
+        wire.write( (uint8_t) i );
+    }
+    return !wire.endTransmission( );
+}
+
+static bool opRead( uint32_t bytes )
+{
+    return wire.requestFrom( DEVICE_ADDRESS, bytes ) == bytes;
+}
+
+static bool opWriteRead( uint32_t bytes )
+{
+    wire.beginTransmission( DEVICE_ADDRESS );
+    wire.write( 0 );
+    return wire.requestFrom( DEVICE_ADDRESS, bytes ) == bytes;
+}
+
+static bool opReadRegister( uint32_t bytes )
+{
+    return !wire.readRegister( DEVICE_ADDRESS, 0, responses[0], bytes );
+}
+
+/**
+ * Run a blocking operation in low power mode; without auto-run the bus
+ * only moves on while the CPU sleeps (or is charged for other work)
+ */
+static bool sleeping( Operation operation, uint32_t bytes )
+{
+    I2CSim::setAutoRun( false );
+    wire.enableLowPower( );
+    bool done = operation( bytes );
+    wire.disableLowPower( );
+    I2CSim::setAutoRun( true );
+    return done;
+}
+
+static bool opWriteSleep( uint32_t bytes )
+{
+    return sleeping( opWrite, bytes );
+}
+
+static bool opReadSleep( uint32_t bytes )
+{
+    return sleeping( opRead, bytes );
+}
+
+uint32_t streamLeft;
+
+static bool produce( uint8_t * data )
+{
+    if (!streamLeft)
+        return false;
+
+    *data = (uint8_t) streamLeft--;
+    return true;
+}
+
+static void consume( uint8_t data )
+{
+}
+
+/**
+ * Let the CPU do other work until an asynchronous transfer has ended
+ */
+static bool finishAsync( bool failed )
+{
+    if (!failed)
+    {
+        while (wire.transferStatus( ) == TRANSFER_PENDING)
+        {
+            I2CSim::advance( WORK_CYCLES );
+        }
+    }
+    I2CSim::setAutoRun( true );
+    return !failed && wire.transferStatus( ) == TRANSFER_SUCCESS;
+}
+
+static bool opWriteAsync( uint32_t bytes )
+{
+    I2CSim::setAutoRun( false );
+    wire.beginTransmission( DEVICE_ADDRESS );
+    for (uint16_t i = 0; i < bytes; i++)
+    {
+        wire.write( (uint8_t) i );
+    }
+    return finishAsync( wire.endTransmissionAsync( ) );
+}
+
+static bool opReadAsync( uint32_t bytes )
+{
+    I2CSim::setAutoRun( false );
+    return finishAsync( wire.requestFromAsync( DEVICE_ADDRESS, bytes ) );
+}
+
+static bool opWriteStream( uint32_t bytes )
+{
+    I2CSim::setAutoRun( false );
+    streamLeft = bytes;
+    return finishAsync( wire.writeStreamAsync( DEVICE_ADDRESS, produce ) );
+}
+
+static bool opReadStream( uint32_t bytes )
+{
+    I2CSim::setAutoRun( false );
+    return finishAsync( wire.readStreamAsync( DEVICE_ADDRESS, bytes, consume ) );
+}
+
+static void countQueued( DWireTransaction * transaction )
+{
+    if (transaction->status == TRANSFER_SUCCESS)
+    {
+        queueCompleted++;
+    }
+}
+
+/**
+ * Queue a transaction as soon as there is room; the slot reused is the
+ * oldest one, which has completed by then. Completions are counted by
+ * countQueued( )
+ */
+static bool enqueue( const uint8_t * writeData, uint8_t writeLength, uint8_t readLength )
+{
+    static uint8_t next;
+    uint8_t slot = next++ % TRANSACTION_QUEUE_SIZE;
+
+    I2CSim::setAutoRun( false );
+    while (wire.queueLength( ) >= TRANSACTION_QUEUE_SIZE)
+    {
+        I2CSim::advance( WORK_CYCLES );
+    }
+
+    DWireTransaction & t = transactions[slot];
+    t.address = DEVICE_ADDRESS;
+    t.writeData = writeData;
+    t.writeLength = writeLength;
+    t.readData = responses[slot];
+    t.readLength = readLength;
+    t.onComplete = countQueued;
+    wire.queue( &t );
+    return false;
+}
+
+static bool opWriteQueue( uint32_t bytes )
+{
+    return enqueue( payload, bytes, 0 );
+}
+
+static bool opReadQueue( uint32_t bytes )
+{
+    return enqueue( 0, 0, bytes );
+}
+
+static void begin( uint8_t speed, bool dma )
+{
+    if (dma)
+    {
+        wire.enableDMA( );
+    }
+    else
+    {
+        wire.disableDMA( );
+    }
+
+    switch (speed)
+    {
+        case STANDARD:
+            wire.setStandardMode( );
+            break;
+
+        case FAST:
+            wire.setFastMode( );
+            break;
+
+        case FASTPLUS:
+            wire.setFastModePlus( );
+            break;
+    }
+    wire.begin( );
+}
+
+static void measure( const char * name, Operation operation, bool dma,
+        uint8_t speed, uint32_t bytes, uint16_t nakRate, uint16_t transactions )
+{
+    device.setNakRate( nakRate );
+    begin( speed, dma );
+    I2CSim::clearStats( );
+
+    uint64_t start = I2CSim::now( );
+    uint32_t completed = 0;
+    queueCompleted = 0;
+    for (int i = 0; i < transactions; i++)
+    {
+        if (operation( bytes ))
+        {
+            completed++;
+        }
+
+        // the main loop keeps the trace ring (DWIRE_TRACE) drained
+        DWireTraceEvent trace[TRACE_SIZE];
+        while (wire.readTrace( trace, TRACE_SIZE ))
+            ;
+    }
+
+    // queued transactions complete in the background
+    while (wire.queueLength( ))
+    {
+        I2CSim::advance( WORK_CYCLES );
+    }
+    I2CSim::setAutoRun( true );
+    completed += queueCompleted;
+    uint64_t elapsed = I2CSim::now( ) - start;
+
+    const I2CSim::Stats & s = I2CSim::stats( BUS );
+    double mclk = MAP_CS_getMCLK( );
+    double payload = (double) completed * bytes;
+
+    printf( "%s,%s,%u,%u,%u,%u,%.0f,%.1f,%.2f,%.4f,%.2f,%.2f\n", name, speedNames[speed],
+            bytes, nakRate, transactions, completed,
+            elapsed ? payload * mclk / elapsed : 0.0,
+            payload ? s.isrCycles / payload : 0.0,
+            s.waitCycles * 1e6 / mclk / transactions,
+            elapsed ? (double) s.busyCycles / elapsed : 0.0,
+            s.gaps ? s.gapCycles * 1e6 / mclk / s.gaps : 0.0,
+            s.sleepCycles * 1e6 / mclk / transactions );
+}
+
+static void sweep( const char * name, Operation operation, bool dma, bool all )
+{
+    for (uint8_t speed = STANDARD; speed <= FASTPLUS; speed++)
+    {
+        for (uint8_t n = 0; n < sizeof(nakRates) / sizeof(nakRates[0]); n++)
+        {
+            if (all)
+            {
+                for (uint16_t bytes = 1; bytes <= 255; bytes++)
+                {
+                    measure( name, operation, dma, speed, bytes, nakRates[n], TRANSACTIONS );
+                }
+            }
+            else
+            {
+                for (uint8_t i = 0; i < sizeof(coarseSizes); i++)
+                {
+                    measure( name, operation, dma, speed, coarseSizes[i], nakRates[n],
+                            TRANSACTIONS );
+                }
+            }
+        }
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    bool all = argc > 1 && !strcmp( argv[1], "all" );
+
+    I2CSim::attach( BUS, &device );
+
+    printf( "op,speed,bytes,nak_permille,transactions,completed,throughput_Bps,"
+            "isr_cycles_per_byte,wait_us_per_txn,bus_utilisation,gap_us,sleep_us_per_txn\n" );
+
+    sweep( "write", opWrite, false, all );
+    sweep( "read", opRead, false, all );
+    sweep( "write-dma", opWrite, true, all );
+    sweep( "read-dma", opRead, true, all );
+    sweep( "write-sleep", opWriteSleep, false, all );
+    sweep( "read-sleep", opReadSleep, false, all );
+    sweep( "write-async", opWriteAsync, false, all );
+    sweep( "read-async", opReadAsync, false, all );
+    sweep( "write-queue", opWriteQueue, false, all );
+    sweep( "read-queue", opReadQueue, false, all );
+    for (uint8_t speed = STANDARD; speed <= FASTPLUS; speed++)
+    {
+        measure( "write-stream", opWriteStream, false, speed, TRANSACTIONS * 255, 0, 1 );
+        measure( "read-stream", opReadStream, false, speed, TRANSACTIONS * 255, 0, 1 );
+    }
+    sweep( "write-read", opWriteRead, false, all );
+    sweep( "read-register", opReadRegister, false, all );
+    return 0;
+}
@@ -0,0 +1,417 @@
+/*
+ * DWire host simulation: demonstration of a master and a slave session.
+ * Every step is checked against what the devices and the virtual master
+ * expect; the demo exits with 1 if any of them differs.
+ *
+ * A register-pointer device is attached to bus B1, which is driven by a
+ * DWire master, and another one to B3, driven by a second master for the
+ * calls on a group of modules. A DWire instance on B0 runs as a slave and is
+ * exercised by the virtual bus master of the simulator, as is a third one
+ * on B2, which serves a register bank on each of two addresses.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <DWire.h>
+#include <I2CScanner.h>
+
+#include "I2CSim.h"
+
+DWire master( 1 );
+DWire auxiliary( 3 );
+DWireT<0> slave;
+DWireT<2> bank;
+
+uint8_t memory[256];
+I2CSimMemory sensor( 0x48, memory, sizeof(memory) );
+uint8_t auxiliaryMemory[256];
+I2CSimMemory gauge( 0x36, auxiliaryMemory, sizeof(auxiliaryMemory) );
+
+/* An identification register, a read-only status and six settings, of
+ * which register 4 only has its low half writable */
+uint8_t bankRegisters[8] = { 0xD7, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+const uint8_t bankWritable[8] = { 0x00, 0x00, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF };
+
+/* Four scratch registers of a second device on the same module */
+uint8_t scratchRegisters[4];
+
+uint8_t received;
+uint8_t receiveCalls;
+uint8_t receivedBytes[8];
+uint8_t firstWritten;
+uint8_t registersWritten;
+uint8_t registerWrites;
+uint8_t requests;
+volatile bool completed;
+
+int failures;
+
+/* Report a step that did not give the expected result */
+void check( bool ok, const char * what )
+{
+    if (!ok)
+    {
+        printf( "FAILED: %s\n", what );
+        failures++;
+    }
+}
+
+/* Compare bytes received with the expected ones */
+void checkBytes( const uint8_t * data, const uint8_t * expected, uint8_t count,
+        const char * what )
+{
+    check( memcmp( data, expected, count ) == 0, what );
+}
+
+void handleReceive( uint8_t numBytes )
+{
+    received = numBytes;
+    receiveCalls++;
+    for (uint8_t i = 0; i < numBytes && i < sizeof(receivedBytes); i++)
+    {
+        receivedBytes[i] = slave.read( );
+    }
+}
+
+void handleRequest( void )
+{
+    requests++;
+    slave.write( 0xCA );
+    slave.write( 0xFE );
+}
+
+void handleRegisterWrite( uint8_t first, uint8_t count )
+{
+    firstWritten = first;
+    registersWritten = count;
+    registerWrites++;
+}
+
+void handleComplete( uint8_t status, uint8_t numBytes )
+{
+    completed = true;
+}
+
+void printFound( unsigned char address )
+{
+    printf( "  device at 0x%02X\n", address );
+}
+
+void printStats( const char * name, uint8_t bus )
+{
+    const I2CSim::Stats & s = I2CSim::stats( bus );
+
+    printf( "%s: %u starts, %u bytes out, %u bytes in, %u NAKs, "
+            "%llu busy cycles, %u ISRs (%llu cycles), %llu cycles waiting\n",
+            name, s.starts, s.bytesTx, s.bytesRx, s.naks,
+            (unsigned long long) s.busyCycles, s.isrEntries,
+            (unsigned long long) s.isrCycles, (unsigned long long) s.waitCycles );
+}
+
+/* The median and the 99th percentile of each phase with a device */
+void printLatency( DWire & wire, uint8_t address )
+{
+    static const char * const phases[] = { "queued", "address", "data", "stop", "total" };
+    double mhz = MAP_CS_getMCLK( ) / 1e6;
+    DWireLatency histograms;
+
+    printf( "latency of 0x%02X over %u transactions (p50/p99 us):", address,
+            wire.latency( address, &histograms ) );
+    for (uint8_t phase = 0; phase < LATENCY_PHASES; phase++)
+    {
+        printf( " %s %.1f/%.1f", phases[phase],
+                wire.latencyPercentile( address, phase, 50 ) / mhz,
+                wire.latencyPercentile( address, phase, 99 ) / mhz );
+    }
+    printf( "\n" );
+}
+
+/* Decode the trace ring of a module, with times relative to its first event */
+void printTrace( DWire & wire )
+{
+    static const char * const names[] = { "?", "START", "TX", "RX", "NAK", "STOP",
+            "DONE", "TIMEOUT", "BUS RESET", "CLOCK LOW", "REQUEST", "REPLIED",
+            "RECEIVE", "ARBITRATION" };
+    DWireTraceEvent events[TRACE_SIZE];
+    uint8_t count = wire.readTrace( events, TRACE_SIZE );
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const DWireTraceEvent & e = events[i];
+        printf( "  %6u us  %-9s", e.time - events[0].time,
+                e.type <= TRACE_ARBITRATION ? names[e.type] : names[0] );
+        if (e.type == TRACE_START)
+        {
+            printf( " 0x%02X %s", e.data >> 1, e.data & 1 ? "read" : "write" );
+        }
+        else if (e.type != TRACE_NAK && e.type != TRACE_STOP && e.type != TRACE_TIMEOUT
+                && e.type != TRACE_CLOCK_LOW)
+        {
+            printf( " %02X", e.data );
+        }
+        printf( "\n" );
+    }
+}
+
+int main( void )
+{
+    I2CSim::attach( 1, &sensor );
+
+    /* Master session */
+    master.setFastMode( );
+    master.begin( );
+
+    // register address followed by the data, sent from this buffer
+    const uint8_t block[] = { 0x10, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7 };
+    master.beginTransmission( 0x48 );
+    master.write( block, sizeof(block) );
+    bool failed = master.endTransmission( );
+    printf( "write: %s\n", failed ? "NAK" : "ok" );
+    check( !failed, "write" );
+    checkBytes( memory + 0x10, block + 1, 8, "bytes written" );
+
+    master.beginTransmission( 0x48 );
+    master.write( 0x10 );
+    uint8_t count = master.requestFrom( 0x48, 8 );
+    uint8_t data[8];
+    printf( "read %u bytes:", count );
+    for (uint8_t i = 0; i < count; i++)
+    {
+        data[i] = master.read( );
+        printf( " %02X", data[i] );
+    }
+    printf( "\n" );
+    check( count == 8, "read count" );
+    checkBytes( data, block + 1, 8, "bytes read" );
+
+    /* Asynchronous read: the CPU keeps working until the ISR completes it */
+    master.onComplete( handleComplete );
+    I2CSim::setAutoRun( false );
+    master.beginTransmission( 0x48 );
+    master.write( 0x14 );
+    master.requestFromAsync( 0x48, 4 );
+    uint32_t work = 0;
+    while (!completed)
+    {
+        I2CSim::advance( 48 );
+        work++;
+    }
+    I2CSim::setAutoRun( true );
+    count = master.transferCount( );
+    printf( "async read %u bytes, %u us of other work:", count, work );
+    for (uint8_t i = 0; i < count; i++)
+    {
+        data[i] = master.read( );
+        printf( " %02X", data[i] );
+    }
+    printf( "\n" );
+    check( count == 4 && master.transferStatus( ) == TRANSFER_SUCCESS, "async read" );
+    checkBytes( data, block + 5, 4, "bytes read asynchronously" );
+    check( work > 0, "work during the async read" );
+
+    /* Register access as one combined transfer */
+    uint8_t value = 0x5A;
+    uint8_t registers[2];
+    master.writeRegister( 0x48, 0x20, value );
+    failed = master.readRegister( 0x48, 0x1F, registers, 2 );
+    printf( "registers 1F-20: %s %02X %02X\n", failed ? "NAK" : "ok", registers[0],
+            registers[1] );
+    check( !failed && memory[0x20] == 0x5A && registers[0] == memory[0x1F]
+            && registers[1] == 0x5A, "register access" );
+
+    printf( "scan:\n" );
+    check( I2CScanner::scan( master, printFound ) == 1, "scan" );
+    uint32_t present[ADDRESS_WORDS] = { 0 };
+    uint64_t scanStart = I2CSim::now( );
+    unsigned char devices = I2CScanner::fastScan( master, present );
+    printf( "fast scan: %u device(s) in %llu us, bitmap %08X %08X %08X %08X\n", devices,
+            (unsigned long long) ((I2CSim::now( ) - scanStart) / (MAP_CS_getMCLK( ) / 1000000)),
+            present[3], present[2], present[1], present[0] );
+    check( devices == 1 && present[0] == 0 && present[1] == 0 && present[2] == 0x100
+            && present[3] == 0, "fast scan" );
+    printStats( "B1", 1 );
+    printLatency( master, 0x48 );
+
+    /* A slave cut off in the middle of a byte holds SDA low: the transfer
+     * times out and the bus is clocked free */
+    master.setTimeout( 1000 );
+    master.enableLowPower( );
+    DWireTraceEvent skipped[TRACE_SIZE];
+    while (master.readTrace( skipped, TRACE_SIZE ))
+        ;
+    I2CSim::holdSda( 1, 5 );
+    master.beginTransmission( 0x48 );
+    master.write( 0x10 );
+    failed = master.endTransmission( );
+    printf( "stuck bus: %s, recovered in %u us with %u SCL pulses\n",
+            master.timedOut( ) ? "timed out" : failed ? "NAK" : "ok",
+            master.recoveryTime( ), I2CSim::stats( 1 ).sclPulses );
+    printTrace( master );
+    check( failed && master.timedOut( ) && I2CSim::stats( 1 ).sclPulses == 6,
+            "stuck bus timeout and recovery" );
+
+    DWireStatistics counters;
+    master.statistics( &counters );
+    printf( "master: %u transactions, %u bytes out, %u bytes in, %u NAKs, %u timeouts, "
+            "%u bus resets, %llu us waiting\n", counters.transactions, counters.bytesTx,
+            counters.bytesRx, counters.naks, counters.timeouts, counters.busResets,
+            (unsigned long long) counters.waitTime );
+    check( counters.timeouts == 1 && counters.busResets == 1, "master statistics" );
+
+    /* Both buses scanned one after the other and then side by side, and a
+     * read from the device on each of them as a group */
+    I2CSim::attach( 3, &gauge );
+    for (int i = 0; i < 8; i++)
+    {
+        auxiliaryMemory[i] = 0xB0 + i;
+    }
+    auxiliary.setFastMode( );
+    auxiliary.enableLowPower( );
+    auxiliary.begin( );
+
+    uint32_t buses[4][ADDRESS_WORDS] = { { 0 } };
+    uint64_t mhz = MAP_CS_getMCLK( ) / 1000000;
+    scanStart = I2CSim::now( );
+    devices = I2CScanner::fastScan( master, buses[1] ) + I2CScanner::fastScan( auxiliary, buses[3] );
+    uint64_t sequential = (I2CSim::now( ) - scanStart) / mhz;
+
+    // time only passes while DWire sleeps, on both buses at once
+    I2CSim::setAutoRun( false );
+    scanStart = I2CSim::now( );
+    devices = I2CScanner::fastScanGroup( GROUP_B1 | GROUP_B3, buses );
+    printf( "group scan: %u device(s) in %llu us, %llu us one bus after the other, "
+            "B1 %08X B3 %08X\n", devices, (unsigned long long) ((I2CSim::now( ) - scanStart) / mhz),
+            (unsigned long long) sequential, buses[1][2], buses[3][1] );
+    check( devices == 2 && buses[1][2] == 0x100 && buses[3][1] == 0x400000, "group scan" );
+    check( (I2CSim::now( ) - scanStart) / mhz < sequential * 3 / 4, "group scan time" );
+
+    const uint8_t modules[2] = { 1, 3 };
+    const uint8_t pointers[2] = { 0x10, 0x00 };
+    uint8_t readings[2][4];
+    DWireTransaction reads[2];
+    memset( reads, 0, sizeof(reads) );
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        reads[i].address = i ? 0x36 : 0x48;
+        reads[i].writeData = &pointers[i];
+        reads[i].writeLength = 1;
+        reads[i].readData = readings[i];
+        reads[i].readLength = sizeof(readings[i]);
+    }
+    scanStart = I2CSim::now( );
+    failed = DWire::transferGroup( reads, modules, 2 );
+    I2CSim::setAutoRun( true );
+    printf( "group read: %s in %llu us, B1 %02X %02X %02X %02X, B3 %02X %02X %02X %02X\n",
+            failed ? "failed" : "ok", (unsigned long long) ((I2CSim::now( ) - scanStart) / mhz),
+            readings[0][0], readings[0][1], readings[0][2], readings[0][3], readings[1][0],
+            readings[1][1], readings[1][2], readings[1][3] );
+    check( !failed && reads[0].status == TRANSFER_SUCCESS && reads[1].status == TRANSFER_SUCCESS,
+            "group read" );
+    checkBytes( readings[0], block + 1, 4, "group read on B1" );
+    checkBytes( readings[1], auxiliaryMemory, 4, "group read on B3" );
+    printStats( "B3", 3 );
+
+    /* Slave session */
+    slave.begin( 0x42 );
+    slave.onReceive( handleReceive );
+    slave.onRequest( handleRequest );
+
+    uint8_t frame[3] = { 1, 2, 3 };
+    int written = I2CSim::masterWrite( 0, 0x42, frame, sizeof(frame) );
+    printf( "slave: master wrote %d bytes, onReceive(%u)\n", written, received );
+    check( written == 3 && receiveCalls == 1 && received == 3, "onReceive" );
+    checkBytes( receivedBytes, frame, 3, "bytes received as a slave" );
+
+    uint8_t response[2];
+    int read = I2CSim::masterRead( 0, 0x42, response, sizeof(response) );
+    printf( "slave: master read %d bytes: %02X %02X\n", read, response[0], response[1] );
+    printTrace( slave );
+    check( read == 2 && requests == 1 && response[0] == 0xCA && response[1] == 0xFE,
+            "onRequest" );
+
+    /* A response staged by the main loop goes out without onRequest */
+    uint8_t * staged = slave.responseBuffer( );
+    staged[0] = 0x12;
+    staged[1] = 0x34;
+    slave.publishResponse( 2 );
+    read = I2CSim::masterRead( 0, 0x42, response, sizeof(response) );
+    printf( "slave: master read %d staged bytes: %02X %02X\n", read, response[0], response[1] );
+    printTrace( slave );
+    check( read == 2 && requests == 1 && response[0] == 0x12 && response[1] == 0x34,
+            "staged response" );
+
+    /* Back-to-back writes wait in the frame ring until the main loop takes
+     * them out, without onReceive */
+    static uint8_t ring[32];
+    slave.receiveFrames( ring, sizeof(ring) );
+    for (uint8_t n = 1; n <= 4; n++)
+    {
+        uint8_t command[6] = { n, 0x10, 0x20, 0x30, 0x40, 0x50 };
+        I2CSim::masterWrite( 0, 0x42, command, n + 1 );
+    }
+    uint8_t length;
+    uint8_t frames = 0;
+    uint8_t command[6];
+    while ((length = slave.readFrame( command, sizeof(command) )) != 0)
+    {
+        printf( "slave: frame of %u bytes, command %02X\n", length, command[0] );
+        frames++;
+        check( length == frames + 1 && command[0] == frames && command[length - 1]
+                == 0x10 * (length - 1), "frame from the ring" );
+    }
+    printf( "slave: %u frames lost\n", slave.framesLost( ) );
+    check( frames == 4 && slave.framesLost( ) == 0 && receiveCalls == 1, "frame ring" );
+    printStats( "B0", 0 );
+
+    /* Register banks served by the ISR alone, one per own address */
+    const uint8_t bankAddresses[2] = { 0x50, 0x51 };
+    bank.registerBank( bankRegisters, sizeof(bankRegisters), bankWritable );
+    bank.onRegisterWrite( handleRegisterWrite );
+    bank.begin( bankAddresses, sizeof(bankAddresses) );
+    bank.registerBank( 0x51, scratchRegisters, sizeof(scratchRegisters), 0 );
+
+    uint8_t settings[5] = { 0x01, 0xAA, 0xBB, 0xCC, 0xDD };
+    I2CSim::masterWrite( 2, 0x50, settings, sizeof(settings) );
+    printf( "bank: onRegisterWrite(%u, %u)\n", firstWritten, registersWritten );
+    check( registerWrites == 1 && firstWritten == 1 && registersWritten == 4,
+            "onRegisterWrite" );
+
+    uint8_t pointer = 0x00;
+    uint8_t contents[8];
+    I2CSim::masterWrite( 2, 0x50, &pointer, 1, false );
+    I2CSim::masterRead( 2, 0x50, contents, 5 );
+    I2CSim::masterRead( 2, 0x50, contents + 5, 3 );
+    printf( "bank: registers" );
+    for (uint8_t i = 0; i < sizeof(contents); i++)
+    {
+        printf( " %02X", contents[i] );
+    }
+    printf( "\n" );
+    // register 1 is read-only and register 4 only takes its low half
+    const uint8_t expected[8] = { 0xD7, 0x01, 0xBB, 0xCC, 0x0D, 0x00, 0x00, 0x00 };
+    checkBytes( contents, expected, 8, "register bank" );
+
+    uint8_t scratch[3] = { 0x02, 0x77, 0x88 };
+    I2CSim::masterWrite( 2, 0x51, scratch, sizeof(scratch) );
+    I2CSim::masterWrite( 2, 0x51, &pointer, 1, false );
+    I2CSim::masterRead( 2, 0x51, contents, 4 );
+    printf( "bank 0x51: registers %02X %02X %02X %02X, 0x50 still %02X\n", contents[0],
+            contents[1], contents[2], contents[3], bankRegisters[2] );
+    check( contents[2] == 0x77 && contents[3] == 0x88 && bankRegisters[2] == 0xBB
+            && registerWrites == 1, "second register bank" );
+    printStats( "B2", 2 );
+
+    printf( "simulated time: %llu cycles\n", (unsigned long long) I2CSim::now( ) );
+    if (failures)
+    {
+        printf( "%d check(s) failed\n", failures );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,604 @@
+/*
+ * DWire host simulation: a stand-in for the MSP432 driverlib.
+ *
+ * The functions follow the register sequences of the MSP432 driverlib,
+ * so they cost and behave as their ROM counterparts do.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+
+#include "I2CSim.h"
+
+/**
+ * Marks the duration of a driverlib call
+ */
+class SimCall
+{
+public:
+    SimCall( ) { I2CSim::_enterCall( ); }
+    ~SimCall( ) { I2CSim::_leaveCall( ); }
+};
+
+static uint8_t busOf( uint32_t moduleInstance )
+{
+    return I2CSim::_registers( moduleInstance )->CTLW0.module;
+}
+
+/**** Peripheral registers ****/
+
+SimRegister16::operator uint16_t( void ) const
+{
+    return I2CSim::_readRegister( this );
+}
+
+SimRegister16 & SimRegister16::operator=( uint16_t newValue )
+{
+    I2CSim::_writeRegister( this, newValue );
+    return *this;
+}
+
+EUSCI_B_Type * EUSCI_B_CMSIS( uint32_t moduleInstance )
+{
+    return I2CSim::_registers( moduleInstance );
+}
+
+/**** eUSCI_B I2C ****/
+
+void I2C_initMaster( uint32_t moduleInstance, const eUSCI_I2C_MasterConfig * config )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+
+    regs->CTLW0 |= EUSCI_B_CTLW0_SWRST;
+    regs->CTLW0 = (regs->CTLW0 & ~EUSCI_B_CTLW0_SSEL_MASK) | config->selectClockSource
+            | EUSCI_B_CTLW0_MST | EUSCI_B_CTLW0_MODE_3 | EUSCI_B_CTLW0_SYNC
+            | EUSCI_B_CTLW0_SWRST;
+    regs->CTLW1 = (regs->CTLW1 & ~EUSCI_B_CTLW1_ASTP_MASK) | config->autoSTOPGeneration;
+    regs->TBCNT = config->byteCounterThreshold;
+    regs->BRW = (uint16_t) (config->i2cClk / config->dataRate);
+}
+
+void I2C_initSlave( uint32_t moduleInstance, uint_fast16_t slaveAddress,
+        uint_fast8_t slaveAddressOffset, uint32_t slaveOwnAddressEnable )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+
+    regs->CTLW0 |= EUSCI_B_CTLW0_SWRST;
+    regs->CTLW0 = EUSCI_B_CTLW0_MODE_3 | EUSCI_B_CTLW0_SYNC | EUSCI_B_CTLW0_SWRST;
+
+    SimRegister16 * ownAddress = &regs->I2COA0 + (slaveAddressOffset >> 1);
+    *ownAddress = (uint16_t) (slaveAddress + slaveOwnAddressEnable);
+}
+
+void I2C_enableModule( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->CTLW0 &= ~EUSCI_B_CTLW0_SWRST;
+}
+
+void I2C_disableModule( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->CTLW0 |= EUSCI_B_CTLW0_SWRST;
+}
+
+void I2C_setSlaveAddress( uint32_t moduleInstance, uint_fast16_t slaveAddress )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->I2CSA = (uint16_t) slaveAddress;
+}
+
+void I2C_setMode( uint32_t moduleInstance, uint_fast8_t mode )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+    regs->CTLW0 = (regs->CTLW0 & ~EUSCI_B_CTLW0_TR) | mode;
+}
+
+uint_fast8_t I2C_getMode( uint32_t moduleInstance )
+{
+    SimCall call;
+    return EUSCI_B_CMSIS( moduleInstance )->CTLW0 & EUSCI_B_CTLW0_TR;
+}
+
+void I2C_slavePutData( uint32_t moduleInstance, uint8_t transmitData )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->TXBUF = transmitData;
+}
+
+uint8_t I2C_slaveGetData( uint32_t moduleInstance )
+{
+    SimCall call;
+    return (uint8_t) EUSCI_B_CMSIS( moduleInstance )->RXBUF;
+}
+
+uint8_t I2C_isBusBusy( uint32_t moduleInstance )
+{
+    SimCall call;
+    return EUSCI_B_CMSIS( moduleInstance )->STATW & EUSCI_B_STATW_BBUSY;
+}
+
+void I2C_masterSendSingleByte( uint32_t moduleInstance, uint8_t txData )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+    uint16_t txieStatus = regs->IE & EUSCI_B_IFG_TXIFG0;
+
+    regs->IE &= ~EUSCI_B_IFG_TXIFG0;
+    regs->CTLW0 |= EUSCI_B_CTLW0_TR | EUSCI_B_CTLW0_TXSTT;
+    I2CSim::_waitFlag( busOf( moduleInstance ), EUSCI_B_IFG_TXIFG0 );
+    regs->TXBUF = txData;
+    I2CSim::_waitFlag( busOf( moduleInstance ), EUSCI_B_IFG_TXIFG0 );
+    regs->CTLW0 |= EUSCI_B_CTLW0_TXSTP;
+    regs->IFG &= ~EUSCI_B_IFG_TXIFG0;
+    regs->IE |= txieStatus;
+}
+
+void I2C_masterSendMultiByteStart( uint32_t moduleInstance, uint8_t txData )
+{
+    I2C_masterSendMultiByteStartWithTimeout( moduleInstance, txData, 0xFFFFFFFF );
+}
+
+bool I2C_masterSendMultiByteStartWithTimeout( uint32_t moduleInstance, uint8_t txData,
+        uint32_t timeout )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+    uint16_t txieStatus = regs->IE & EUSCI_B_IFG_TXIFG0;
+
+    regs->IE &= ~EUSCI_B_IFG_TXIFG0;
+    regs->CTLW0 |= EUSCI_B_CTLW0_TR | EUSCI_B_CTLW0_TXSTT;
+
+    I2CSim::_waitFlag( busOf( moduleInstance ), EUSCI_B_IFG_TXIFG0, timeout );
+    if (!(regs->IFG & EUSCI_B_IFG_TXIFG0))
+    {
+        return false;
+    }
+
+    regs->TXBUF = txData;
+    regs->IE |= txieStatus;
+    return true;
+}
+
+void I2C_masterSendMultiByteNext( uint32_t moduleInstance, uint8_t txData )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+
+    if (!(regs->IE & EUSCI_B_IFG_TXIFG0))
+    {
+        I2CSim::_waitFlag( busOf( moduleInstance ), EUSCI_B_IFG_TXIFG0 );
+    }
+    regs->TXBUF = txData;
+}
+
+void I2C_masterSendMultiByteStop( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+
+    if (!(regs->IE & EUSCI_B_IFG_TXIFG0))
+    {
+        I2CSim::_waitFlag( busOf( moduleInstance ), EUSCI_B_IFG_TXIFG0 );
+    }
+    regs->CTLW0 |= EUSCI_B_CTLW0_TXSTP;
+}
+
+void I2C_masterReceiveStart( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+    regs->CTLW0 = (regs->CTLW0 & ~EUSCI_B_CTLW0_TR) | EUSCI_B_CTLW0_TXSTT;
+}
+
+uint8_t I2C_masterReceiveMultiByteNext( uint32_t moduleInstance )
+{
+    SimCall call;
+    return (uint8_t) EUSCI_B_CMSIS( moduleInstance )->RXBUF;
+}
+
+void I2C_masterReceiveMultiByteStop( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->CTLW0 |= EUSCI_B_CTLW0_TXSTP;
+}
+
+uint8_t I2C_masterIsStopSent( uint32_t moduleInstance )
+{
+    SimCall call;
+    return EUSCI_B_CMSIS( moduleInstance )->CTLW0 & EUSCI_B_CTLW0_TXSTP;
+}
+
+bool I2C_masterIsStartSent( uint32_t moduleInstance )
+{
+    SimCall call;
+    return EUSCI_B_CMSIS( moduleInstance )->CTLW0 & EUSCI_B_CTLW0_TXSTT;
+}
+
+void I2C_masterSendStart( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->CTLW0 |= EUSCI_B_CTLW0_TXSTT;
+}
+
+void I2C_enableInterrupt( uint32_t moduleInstance, uint_fast16_t mask )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->IE |= (uint16_t) mask;
+}
+
+void I2C_disableInterrupt( uint32_t moduleInstance, uint_fast16_t mask )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->IE &= (uint16_t) ~mask;
+}
+
+void I2C_clearInterruptFlag( uint32_t moduleInstance, uint_fast16_t mask )
+{
+    SimCall call;
+    EUSCI_B_CMSIS( moduleInstance )->IFG &= (uint16_t) ~mask;
+}
+
+uint_fast16_t I2C_getInterruptStatus( uint32_t moduleInstance, uint16_t mask )
+{
+    SimCall call;
+    return EUSCI_B_CMSIS( moduleInstance )->IFG & mask;
+}
+
+uint_fast16_t I2C_getEnabledInterruptStatus( uint32_t moduleInstance )
+{
+    SimCall call;
+    EUSCI_B_Type * regs = EUSCI_B_CMSIS( moduleInstance );
+    return regs->IFG & regs->IE;
+}
+
+void I2C_registerInterrupt( uint32_t moduleInstance, void (*intHandler)( void ) )
+{
+    SimCall call;
+    uint32_t interrupt = INT_EUSCIB0 + busOf( moduleInstance );
+
+    I2CSim::_registerInterrupt( interrupt, intHandler );
+    I2CSim::_enableInterrupt( interrupt, true );
+}
+
+void I2C_unregisterInterrupt( uint32_t moduleInstance )
+{
+    SimCall call;
+    uint32_t interrupt = INT_EUSCIB0 + busOf( moduleInstance );
+
+    I2CSim::_enableInterrupt( interrupt, false );
+    I2CSim::_registerInterrupt( interrupt, 0 );
+}
+
+/**** uDMA ****/
+
+static bool dmaModule;
+static void * dmaControlBase;
+
+/* Channel number part of a channel mapping or control structure index */
+#define DMA_CHANNEL_OF( x ) ((uint8_t) ((x) & 0x07))
+
+void DMA_enableModule( void )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    dmaModule = true;
+}
+
+void DMA_disableModule( void )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    dmaModule = false;
+    for (uint8_t c = 0; c < I2CSIM_DMA_CHANNELS; c++)
+    {
+        I2CSim::_dmaChannel( c )->enabled = false;
+    }
+}
+
+void DMA_setControlBase( void * controlTable )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    dmaControlBase = controlTable;
+}
+
+void * DMA_getControlBase( void )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    return dmaControlBase;
+}
+
+void DMA_assignChannel( uint32_t mapping )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_dmaChannel( DMA_CHANNEL_OF( mapping ) )->source = (uint8_t) (mapping >> 24);
+}
+
+void DMA_enableChannelAttribute( uint32_t channelNum, uint32_t attr )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+}
+
+void DMA_disableChannelAttribute( uint32_t channelNum, uint32_t attr )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+}
+
+void DMA_setChannelControl( uint32_t channelStructIndex, uint32_t control )
+{
+    SimCall call;
+    I2CSim::_charge( 2 * I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelStructIndex ) )->control = control;
+}
+
+void DMA_setChannelTransfer( uint32_t channelStructIndex, uint32_t mode,
+        void * srcAddr, void * dstAddr, uint32_t transferSize )
+{
+    SimCall call;
+    I2CSim::DmaChannel * ch = I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelStructIndex ) );
+
+    // source end, destination end and control word of the structure
+    I2CSim::_charge( 4 * I2CSim::REGISTER_ACCESS_CYCLES );
+    ch->src = (uint8_t *) srcAddr;
+    ch->dst = (uint8_t *) dstAddr;
+    ch->remaining = mode == UDMA_MODE_STOP ? 0 : transferSize;
+}
+
+void DMA_enableChannel( uint32_t channelNum )
+{
+    SimCall call;
+    I2CSim::DmaChannel * ch = I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelNum ) );
+
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    if (!dmaModule || !dmaControlBase)
+    {
+        fprintf( stderr, "I2CSim: DMA channel %u enabled without a control table\n",
+                DMA_CHANNEL_OF( channelNum ) );
+        return;
+    }
+    ch->enabled = ch->remaining > 0;
+    I2CSim::_dmaUpdate( );
+}
+
+void DMA_disableChannel( uint32_t channelNum )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelNum ) )->enabled = false;
+}
+
+bool DMA_isChannelEnabled( uint32_t channelNum )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    return I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelNum ) )->enabled;
+}
+
+uint32_t DMA_getChannelSize( uint32_t channelStructIndex )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    return I2CSim::_dmaChannel( DMA_CHANNEL_OF( channelStructIndex ) )->remaining;
+}
+
+/**** GPIO ****/
+
+void GPIO_setAsPeripheralModuleFunctionInputPin( uint_fast8_t selectedPort,
+        uint_fast16_t selectedPins, uint_fast8_t mode )
+{
+    SimCall call;
+    I2CSim::_gpio( selectedPort, selectedPins, I2CSim::GPIO_OP_PERIPHERAL );
+}
+
+void GPIO_setAsOutputPin( uint_fast8_t selectedPort, uint_fast16_t selectedPins )
+{
+    SimCall call;
+    I2CSim::_gpio( selectedPort, selectedPins, I2CSim::GPIO_OP_OUTPUT );
+}
+
+void GPIO_setAsInputPin( uint_fast8_t selectedPort, uint_fast16_t selectedPins )
+{
+    SimCall call;
+    I2CSim::_gpio( selectedPort, selectedPins, I2CSim::GPIO_OP_INPUT );
+}
+
+void GPIO_setOutputLowOnPin( uint_fast8_t selectedPort, uint_fast16_t selectedPins )
+{
+    SimCall call;
+    I2CSim::_gpio( selectedPort, selectedPins, I2CSim::GPIO_OP_LOW );
+}
+
+void GPIO_setOutputHighOnPin( uint_fast8_t selectedPort, uint_fast16_t selectedPins )
+{
+    SimCall call;
+    I2CSim::_gpio( selectedPort, selectedPins, I2CSim::GPIO_OP_HIGH );
+}
+
+uint8_t GPIO_getInputPinValue( uint_fast8_t selectedPort, uint_fast16_t selectedPins )
+{
+    SimCall call;
+    return I2CSim::_gpioInput( selectedPort, selectedPins );
+}
+
+/**** NVIC ****/
+
+void Interrupt_enableInterrupt( uint32_t interruptNumber )
+{
+    SimCall call;
+    I2CSim::_enableInterrupt( interruptNumber, true );
+}
+
+void Interrupt_disableInterrupt( uint32_t interruptNumber )
+{
+    SimCall call;
+    I2CSim::_enableInterrupt( interruptNumber, false );
+}
+
+bool Interrupt_isEnabled( uint32_t interruptNumber )
+{
+    SimCall call;
+    return I2CSim::_isInterruptEnabled( interruptNumber );
+}
+
+bool Interrupt_enableMaster( void )
+{
+    SimCall call;
+    return I2CSim::_enableMaster( true );
+}
+
+bool Interrupt_disableMaster( void )
+{
+    SimCall call;
+    return I2CSim::_enableMaster( false );
+}
+
+void Interrupt_registerInterrupt( uint32_t interruptNumber, void (*intHandler)( void ) )
+{
+    SimCall call;
+    I2CSim::_registerInterrupt( interruptNumber, intHandler );
+}
+
+/**** Timer32 ****/
+
+void Timer32_initModule( uint32_t timer, uint32_t preScaler, uint32_t resolution,
+        uint32_t mode )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Control( I2CSim::_timer32( timer ), preScaler | resolution | mode );
+}
+
+void Timer32_setCount( uint32_t timer, uint32_t count )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Load( I2CSim::_timer32( timer ), count );
+}
+
+uint32_t Timer32_getValue( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    return I2CSim::_timer32Value( I2CSim::_timer32( timer ) );
+}
+
+void Timer32_startTimer( uint32_t timer, bool oneShot )
+{
+    SimCall call;
+    I2CSim::Timer32 * t = I2CSim::_timer32( timer );
+
+    I2CSim::_charge( 2 * I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Control( t, (t->control & ~TIMER32_CONTROL_ONESHOT)
+            | TIMER32_CONTROL_ENABLE | (oneShot ? TIMER32_CONTROL_ONESHOT : 0) );
+}
+
+void Timer32_haltTimer( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::Timer32 * t = I2CSim::_timer32( timer );
+
+    I2CSim::_charge( 2 * I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Control( t, t->control & ~TIMER32_CONTROL_ENABLE );
+}
+
+void Timer32_enableInterrupt( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::Timer32 * t = I2CSim::_timer32( timer );
+
+    I2CSim::_charge( 2 * I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Control( t, t->control | TIMER32_CONTROL_IE );
+}
+
+void Timer32_disableInterrupt( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::Timer32 * t = I2CSim::_timer32( timer );
+
+    I2CSim::_charge( 2 * I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32Control( t, t->control & ~TIMER32_CONTROL_IE );
+}
+
+void Timer32_clearInterruptFlag( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    I2CSim::_timer32( timer )->pending = false;
+}
+
+uint32_t Timer32_getInterruptStatus( uint32_t timer )
+{
+    SimCall call;
+    I2CSim::Timer32 * t = I2CSim::_timer32( timer );
+
+    I2CSim::_charge( I2CSim::REGISTER_ACCESS_CYCLES );
+    return t->pending && (t->control & TIMER32_CONTROL_IE);
+}
+
+void Timer32_registerInterrupt( uint32_t timerInterrupt, void (*intHandler)( void ) )
+{
+    SimCall call;
+    I2CSim::_registerInterrupt( timerInterrupt, intHandler );
+    I2CSim::_enableInterrupt( timerInterrupt, true );
+}
+
+/**** Clock system and reset controller ****/
+
+uint32_t CS_getMCLK( void )
+{
+    SimCall call;
+    return I2CSim::_mclk( );
+}
+
+uint32_t CS_getSMCLK( void )
+{
+    SimCall call;
+    return I2CSim::_smclk( );
+}
+
+/**** Power control ****/
+
+bool PCM_gotoLPM0( void )
+{
+    SimCall call;
+    return I2CSim::_sleep( );
+}
+
+void ResetCtl_initiateHardReset( void )
+{
+    SimCall call;
+    fprintf( stderr, "I2CSim: hard reset requested\n" );
+    I2CSim::_hardReset( );
+}
+
+/**** Cortex-M4 debug ****/
+
+static DWT_Type dwt;
+static CoreDebug_Type coreDebug;
+
+DWT_Type * const DWT = &dwt;
+CoreDebug_Type * const CoreDebug = &coreDebug;
+
+SimCycleCounter::operator uint32_t( void ) const
+{
+    return I2CSim::_cycleCounter( );
+}
+
+/**** Intrinsics ****/
+
+void __no_operation( void )
+{
+    I2CSim::_charge( I2CSim::NOP_LOOP_CYCLES );
+}
@@ -0,0 +1,472 @@
+/*
+ * DWire host simulation: a stand-in for the MSP432 driverlib.
+ *
+ * Only the part of the driverlib API used by DWire is provided. The
+ * eUSCI_B register block is backed by the I2CSim bus model, so both the
+ * MAP_ calls and direct EUSCI_B_CMSIS() register accesses behave like
+ * the hardware does, including the interrupt flags that drive the
+ * EUSCIBx_IRQHandler_I2C handlers. The uDMA model supports the eUSCI_B
+ * TX0/RX0 triggers in basic mode, the Timer32 model the one-shot,
+ * periodic and free running modes.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_HOST_DRIVERLIB_H_
+#define DWIRE_HOST_DRIVERLIB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**** Peripheral register block ****/
+
+/**
+ * A 16-bit peripheral register: every access is routed through the
+ * simulator, which charges the bus access and applies side effects
+ * (e.g. reading RXBUF clears RXIFG, setting UCTXSTT starts a transfer)
+ */
+class SimRegister16
+{
+public:
+    operator uint16_t( void ) const;
+    SimRegister16 & operator=( uint16_t );
+    SimRegister16 & operator=( const SimRegister16 & other ) { return *this = (uint16_t) other; }
+    SimRegister16 & operator|=( uint16_t value ) { return *this = (uint16_t) (*this | value); }
+    SimRegister16 & operator&=( uint16_t value ) { return *this = (uint16_t) (*this & value); }
+    SimRegister16 & operator^=( uint16_t value ) { return *this = (uint16_t) (*this ^ value); }
+
+    /* Raw register contents, used by the simulator itself */
+    uint16_t value;
+    uint8_t module;
+    uint8_t offset;
+};
+
+typedef struct
+{
+    SimRegister16 CTLW0;
+    SimRegister16 CTLW1;
+    SimRegister16 RESERVED0;
+    SimRegister16 BRW;
+    SimRegister16 STATW;
+    SimRegister16 TBCNT;
+    SimRegister16 RXBUF;
+    SimRegister16 TXBUF;
+    SimRegister16 RESERVED1[2];
+    SimRegister16 I2COA0;
+    SimRegister16 I2COA1;
+    SimRegister16 I2COA2;
+    SimRegister16 I2COA3;
+    SimRegister16 ADDRX;
+    SimRegister16 ADDMASK;
+    SimRegister16 I2CSA;
+    SimRegister16 RESERVED2[4];
+    SimRegister16 IE;
+    SimRegister16 IFG;
+    SimRegister16 IV;
+} EUSCI_B_Type;
+
+EUSCI_B_Type * EUSCI_B_CMSIS( uint32_t );
+
+#define EUSCI_B0_BASE 0x40002000
+#define EUSCI_B1_BASE 0x40002400
+#define EUSCI_B2_BASE 0x40002800
+#define EUSCI_B3_BASE 0x40002C00
+
+/* UCBxCTLW0 */
+#define EUSCI_B_CTLW0_SWRST         0x0001
+#define EUSCI_B_CTLW0_TXSTT         0x0002
+#define EUSCI_B_CTLW0_TXSTP         0x0004
+#define EUSCI_B_CTLW0_TXNACK        0x0008
+#define EUSCI_B_CTLW0_TR            0x0010
+#define EUSCI_B_CTLW0_TXACK         0x0020
+#define EUSCI_B_CTLW0_SSEL_MASK     0x00C0
+#define EUSCI_B_CTLW0_SSEL__ACLK    0x0040
+#define EUSCI_B_CTLW0_SSEL__SMCLK   0x0080
+#define EUSCI_B_CTLW0_SYNC          0x0100
+#define EUSCI_B_CTLW0_MODE_3        0x0600
+#define EUSCI_B_CTLW0_MST           0x0800
+#define EUSCI_B_CTLW0_MM            0x2000
+
+/* UCBxCTLW1 */
+#define EUSCI_B_CTLW1_ASTP_MASK     0x000C
+#define EUSCI_B_CTLW1_ASTP_0        0x0000
+#define EUSCI_B_CTLW1_ASTP_1        0x0004
+#define EUSCI_B_CTLW1_ASTP_2        0x0008
+#define EUSCI_B_CTLW1_SWACK         0x0010
+#define EUSCI_B_CTLW1_CLTO_MASK     0x00C0
+#define EUSCI_B_CTLW1_CLTO_1        0x0040
+#define EUSCI_B_CTLW1_CLTO_2        0x0080
+#define EUSCI_B_CTLW1_CLTO_3        0x00C0
+
+/* UCBxSTATW */
+#define EUSCI_B_STATW_BBUSY         0x0010
+#define EUSCI_B_STATW_GC            0x0020
+#define EUSCI_B_STATW_SCLLOW        0x0040
+#define EUSCI_B_STATW_BCNT_MASK     0xFF00
+#define EUSCI_B_STATW_BCNT_OFS      8
+
+/* UCBxI2COAx */
+#define EUSCI_B_I2COA0_OAEN         0x0400
+
+/* UCBxIE / UCBxIFG */
+#define EUSCI_B_IFG_RXIFG0          0x0001
+#define EUSCI_B_IFG_TXIFG0          0x0002
+#define EUSCI_B_IFG_STTIFG          0x0004
+#define EUSCI_B_IFG_STPIFG          0x0008
+#define EUSCI_B_IFG_ALIFG           0x0010
+#define EUSCI_B_IFG_NACKIFG         0x0020
+#define EUSCI_B_IFG_BCNTIFG         0x0040
+#define EUSCI_B_IFG_CLTOIFG         0x0080
+#define EUSCI_B_IFG_RXIFG1          0x0100
+#define EUSCI_B_IFG_TXIFG1          0x0200
+#define EUSCI_B_IFG_RXIFG2          0x0400
+#define EUSCI_B_IFG_TXIFG2          0x0800
+#define EUSCI_B_IFG_RXIFG3          0x1000
+#define EUSCI_B_IFG_TXIFG3          0x2000
+#define EUSCI_B_IFG_BIT9IFG         0x4000
+
+/**** eUSCI_B I2C driverlib API ****/
+
+#define EUSCI_B_I2C_NAK_INTERRUPT                EUSCI_B_IFG_NACKIFG
+#define EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT    EUSCI_B_IFG_ALIFG
+#define EUSCI_B_I2C_STOP_INTERRUPT               EUSCI_B_IFG_STPIFG
+#define EUSCI_B_I2C_START_INTERRUPT              EUSCI_B_IFG_STTIFG
+#define EUSCI_B_I2C_TRANSMIT_INTERRUPT0          EUSCI_B_IFG_TXIFG0
+#define EUSCI_B_I2C_TRANSMIT_INTERRUPT1          EUSCI_B_IFG_TXIFG1
+#define EUSCI_B_I2C_TRANSMIT_INTERRUPT2          EUSCI_B_IFG_TXIFG2
+#define EUSCI_B_I2C_TRANSMIT_INTERRUPT3          EUSCI_B_IFG_TXIFG3
+#define EUSCI_B_I2C_RECEIVE_INTERRUPT0           EUSCI_B_IFG_RXIFG0
+#define EUSCI_B_I2C_RECEIVE_INTERRUPT1           EUSCI_B_IFG_RXIFG1
+#define EUSCI_B_I2C_RECEIVE_INTERRUPT2           EUSCI_B_IFG_RXIFG2
+#define EUSCI_B_I2C_RECEIVE_INTERRUPT3           EUSCI_B_IFG_RXIFG3
+#define EUSCI_B_I2C_BIT9_POSITION_INTERRUPT      EUSCI_B_IFG_BIT9IFG
+#define EUSCI_B_I2C_CLOCK_LOW_TIMEOUT_INTERRUPT  EUSCI_B_IFG_CLTOIFG
+#define EUSCI_B_I2C_BYTE_COUNTER_INTERRUPT       EUSCI_B_IFG_BCNTIFG
+
+#define EUSCI_B_I2C_TRANSMIT_MODE                EUSCI_B_CTLW0_TR
+#define EUSCI_B_I2C_RECEIVE_MODE                 0x00
+
+#define EUSCI_B_I2C_SENDING_STOP                 EUSCI_B_CTLW0_TXSTP
+#define EUSCI_B_I2C_STOP_SEND_COMPLETE           0x00
+#define EUSCI_B_I2C_SENDING_START                EUSCI_B_CTLW0_TXSTT
+#define EUSCI_B_I2C_START_SEND_COMPLETE          0x00
+
+#define EUSCI_B_I2C_BUS_BUSY                     EUSCI_B_STATW_BBUSY
+#define EUSCI_B_I2C_BUS_NOT_BUSY                 0x00
+
+#define EUSCI_B_I2C_OWN_ADDRESS_OFFSET0          0x00
+#define EUSCI_B_I2C_OWN_ADDRESS_OFFSET1          0x02
+#define EUSCI_B_I2C_OWN_ADDRESS_OFFSET2          0x04
+#define EUSCI_B_I2C_OWN_ADDRESS_OFFSET3          0x06
+#define EUSCI_B_I2C_OWN_ADDRESS_ENABLE           EUSCI_B_I2COA0_OAEN
+#define EUSCI_B_I2C_OWN_ADDRESS_DISABLE          0x00
+
+#define EUSCI_B_I2C_CLOCKSOURCE_ACLK             EUSCI_B_CTLW0_SSEL__ACLK
+#define EUSCI_B_I2C_CLOCKSOURCE_SMCLK            EUSCI_B_CTLW0_SSEL__SMCLK
+
+#define EUSCI_B_I2C_NO_AUTO_STOP                 EUSCI_B_CTLW1_ASTP_0
+#define EUSCI_B_I2C_SET_BYTECOUNT_THRESHOLD_FLAG EUSCI_B_CTLW1_ASTP_1
+#define EUSCI_B_I2C_SEND_STOP_AUTOMATICALLY_ON_BYTECOUNT_THRESHOLD EUSCI_B_CTLW1_ASTP_2
+
+#define EUSCI_B_I2C_SET_DATA_RATE_1MBPS          1000000
+#define EUSCI_B_I2C_SET_DATA_RATE_400KBPS        400000
+#define EUSCI_B_I2C_SET_DATA_RATE_100KBPS        100000
+
+typedef struct _eUSCI_I2C_MasterConfig
+{
+    uint_fast8_t selectClockSource;
+    uint32_t i2cClk;
+    uint32_t dataRate;
+    uint_fast8_t byteCounterThreshold;
+    uint_fast8_t autoSTOPGeneration;
+} eUSCI_I2C_MasterConfig;
+
+void I2C_initMaster( uint32_t, const eUSCI_I2C_MasterConfig * );
+void I2C_initSlave( uint32_t, uint_fast16_t, uint_fast8_t, uint32_t );
+void I2C_enableModule( uint32_t );
+void I2C_disableModule( uint32_t );
+void I2C_setSlaveAddress( uint32_t, uint_fast16_t );
+void I2C_setMode( uint32_t, uint_fast8_t );
+uint_fast8_t I2C_getMode( uint32_t );
+void I2C_slavePutData( uint32_t, uint8_t );
+uint8_t I2C_slaveGetData( uint32_t );
+uint8_t I2C_isBusBusy( uint32_t );
+void I2C_masterSendSingleByte( uint32_t, uint8_t );
+void I2C_masterSendMultiByteStart( uint32_t, uint8_t );
+bool I2C_masterSendMultiByteStartWithTimeout( uint32_t, uint8_t, uint32_t );
+void I2C_masterSendMultiByteNext( uint32_t, uint8_t );
+void I2C_masterSendMultiByteStop( uint32_t );
+void I2C_masterReceiveStart( uint32_t );
+uint8_t I2C_masterReceiveMultiByteNext( uint32_t );
+void I2C_masterReceiveMultiByteStop( uint32_t );
+uint8_t I2C_masterIsStopSent( uint32_t );
+bool I2C_masterIsStartSent( uint32_t );
+void I2C_masterSendStart( uint32_t );
+void I2C_enableInterrupt( uint32_t, uint_fast16_t );
+void I2C_disableInterrupt( uint32_t, uint_fast16_t );
+void I2C_clearInterruptFlag( uint32_t, uint_fast16_t );
+uint_fast16_t I2C_getInterruptStatus( uint32_t, uint16_t );
+uint_fast16_t I2C_getEnabledInterruptStatus( uint32_t );
+void I2C_registerInterrupt( uint32_t, void (*)( void ) );
+void I2C_unregisterInterrupt( uint32_t );
+
+#define MAP_I2C_initMaster                        I2C_initMaster
+#define MAP_I2C_initSlave                         I2C_initSlave
+#define MAP_I2C_enableModule                      I2C_enableModule
+#define MAP_I2C_disableModule                     I2C_disableModule
+#define MAP_I2C_setSlaveAddress                   I2C_setSlaveAddress
+#define MAP_I2C_setMode                           I2C_setMode
+#define MAP_I2C_getMode                           I2C_getMode
+#define MAP_I2C_slavePutData                      I2C_slavePutData
+#define MAP_I2C_slaveGetData                      I2C_slaveGetData
+#define MAP_I2C_isBusBusy                         I2C_isBusBusy
+#define MAP_I2C_masterSendSingleByte              I2C_masterSendSingleByte
+#define MAP_I2C_masterSendMultiByteStart          I2C_masterSendMultiByteStart
+#define MAP_I2C_masterSendMultiByteStartWithTimeout I2C_masterSendMultiByteStartWithTimeout
+#define MAP_I2C_masterSendMultiByteNext           I2C_masterSendMultiByteNext
+#define MAP_I2C_masterSendMultiByteStop           I2C_masterSendMultiByteStop
+#define MAP_I2C_masterReceiveStart                I2C_masterReceiveStart
+#define MAP_I2C_masterReceiveMultiByteNext        I2C_masterReceiveMultiByteNext
+#define MAP_I2C_masterReceiveMultiByteStop        I2C_masterReceiveMultiByteStop
+#define MAP_I2C_masterIsStopSent                  I2C_masterIsStopSent
+#define MAP_I2C_masterIsStartSent                 I2C_masterIsStartSent
+#define MAP_I2C_masterSendStart                   I2C_masterSendStart
+#define MAP_I2C_enableInterrupt                   I2C_enableInterrupt
+#define MAP_I2C_disableInterrupt                  I2C_disableInterrupt
+#define MAP_I2C_clearInterruptFlag                I2C_clearInterruptFlag
+#define MAP_I2C_getInterruptStatus                I2C_getInterruptStatus
+#define MAP_I2C_getEnabledInterruptStatus         I2C_getEnabledInterruptStatus
+#define MAP_I2C_registerInterrupt                 I2C_registerInterrupt
+#define MAP_I2C_unregisterInterrupt               I2C_unregisterInterrupt
+
+/**** GPIO ****/
+
+#define GPIO_PORT_P1 1
+#define GPIO_PORT_P2 2
+#define GPIO_PORT_P3 3
+#define GPIO_PORT_P4 4
+#define GPIO_PORT_P5 5
+#define GPIO_PORT_P6 6
+
+#define GPIO_PIN0 0x0001
+#define GPIO_PIN1 0x0002
+#define GPIO_PIN2 0x0004
+#define GPIO_PIN3 0x0008
+#define GPIO_PIN4 0x0010
+#define GPIO_PIN5 0x0020
+#define GPIO_PIN6 0x0040
+#define GPIO_PIN7 0x0080
+
+#define GPIO_PRIMARY_MODULE_FUNCTION 0x01
+
+#define GPIO_INPUT_PIN_HIGH 0x01
+#define GPIO_INPUT_PIN_LOW  0x00
+
+void GPIO_setAsPeripheralModuleFunctionInputPin( uint_fast8_t, uint_fast16_t, uint_fast8_t );
+void GPIO_setAsOutputPin( uint_fast8_t, uint_fast16_t );
+void GPIO_setAsInputPin( uint_fast8_t, uint_fast16_t );
+void GPIO_setOutputLowOnPin( uint_fast8_t, uint_fast16_t );
+void GPIO_setOutputHighOnPin( uint_fast8_t, uint_fast16_t );
+uint8_t GPIO_getInputPinValue( uint_fast8_t, uint_fast16_t );
+
+#define MAP_GPIO_setAsPeripheralModuleFunctionInputPin GPIO_setAsPeripheralModuleFunctionInputPin
+#define MAP_GPIO_setAsOutputPin                   GPIO_setAsOutputPin
+#define MAP_GPIO_setAsInputPin                    GPIO_setAsInputPin
+#define MAP_GPIO_setOutputLowOnPin                GPIO_setOutputLowOnPin
+#define MAP_GPIO_setOutputHighOnPin               GPIO_setOutputHighOnPin
+#define MAP_GPIO_getInputPinValue                 GPIO_getInputPinValue
+
+/**** NVIC ****/
+
+#define INT_EUSCIB0 36
+#define INT_EUSCIB1 37
+#define INT_EUSCIB2 38
+#define INT_EUSCIB3 39
+
+void Interrupt_enableInterrupt( uint32_t );
+void Interrupt_disableInterrupt( uint32_t );
+bool Interrupt_isEnabled( uint32_t );
+bool Interrupt_enableMaster( void );
+bool Interrupt_disableMaster( void );
+void Interrupt_registerInterrupt( uint32_t, void (*)( void ) );
+
+#define MAP_Interrupt_enableInterrupt             Interrupt_enableInterrupt
+#define MAP_Interrupt_disableInterrupt            Interrupt_disableInterrupt
+#define MAP_Interrupt_isEnabled                   Interrupt_isEnabled
+#define MAP_Interrupt_enableMaster                Interrupt_enableMaster
+#define MAP_Interrupt_disableMaster               Interrupt_disableMaster
+#define MAP_Interrupt_registerInterrupt           Interrupt_registerInterrupt
+
+/**** uDMA ****/
+
+#define DMA_CHANNEL_0 0
+#define DMA_CHANNEL_1 1
+#define DMA_CHANNEL_2 2
+#define DMA_CHANNEL_3 3
+#define DMA_CHANNEL_4 4
+#define DMA_CHANNEL_5 5
+#define DMA_CHANNEL_6 6
+#define DMA_CHANNEL_7 7
+
+#define DMA_CH0_EUSCIB0TX0 0x02000000
+#define DMA_CH1_EUSCIB0RX0 0x02000001
+#define DMA_CH2_EUSCIB1TX0 0x02000002
+#define DMA_CH3_EUSCIB1RX0 0x02000003
+#define DMA_CH4_EUSCIB2TX0 0x02000004
+#define DMA_CH5_EUSCIB2RX0 0x02000005
+#define DMA_CH6_EUSCIB3TX0 0x02000006
+#define DMA_CH7_EUSCIB3RX0 0x02000007
+
+#define UDMA_PRI_SELECT          0x00000000
+#define UDMA_ALT_SELECT          0x00000020
+
+#define UDMA_ATTR_USEBURST       0x00000001
+#define UDMA_ATTR_ALTSELECT      0x00000002
+#define UDMA_ATTR_HIGH_PRIORITY  0x00000004
+#define UDMA_ATTR_REQMASK        0x00000008
+#define UDMA_ATTR_ALL            0x0000000F
+
+#define UDMA_DST_INC_8           0x00000000
+#define UDMA_DST_INC_NONE        0xC0000000
+#define UDMA_SRC_INC_8           0x00000000
+#define UDMA_SRC_INC_NONE        0x0C000000
+#define UDMA_SIZE_8              0x00000000
+#define UDMA_ARB_1               0x00000000
+
+#define UDMA_MODE_STOP           0x00000000
+#define UDMA_MODE_BASIC          0x00000001
+
+void DMA_enableModule( void );
+void DMA_disableModule( void );
+void DMA_setControlBase( void * );
+void * DMA_getControlBase( void );
+void DMA_assignChannel( uint32_t );
+void DMA_enableChannelAttribute( uint32_t, uint32_t );
+void DMA_disableChannelAttribute( uint32_t, uint32_t );
+void DMA_setChannelControl( uint32_t, uint32_t );
+void DMA_setChannelTransfer( uint32_t, uint32_t, void *, void *, uint32_t );
+void DMA_enableChannel( uint32_t );
+void DMA_disableChannel( uint32_t );
+bool DMA_isChannelEnabled( uint32_t );
+uint32_t DMA_getChannelSize( uint32_t );
+
+#define MAP_DMA_enableModule                      DMA_enableModule
+#define MAP_DMA_disableModule                     DMA_disableModule
+#define MAP_DMA_setControlBase                    DMA_setControlBase
+#define MAP_DMA_getControlBase                    DMA_getControlBase
+#define MAP_DMA_assignChannel                     DMA_assignChannel
+#define MAP_DMA_enableChannelAttribute            DMA_enableChannelAttribute
+#define MAP_DMA_disableChannelAttribute           DMA_disableChannelAttribute
+#define MAP_DMA_setChannelControl                 DMA_setChannelControl
+#define MAP_DMA_setChannelTransfer                DMA_setChannelTransfer
+#define MAP_DMA_enableChannel                     DMA_enableChannel
+#define MAP_DMA_disableChannel                    DMA_disableChannel
+#define MAP_DMA_isChannelEnabled                  DMA_isChannelEnabled
+#define MAP_DMA_getChannelSize                    DMA_getChannelSize
+
+/**** Timer32 ****/
+
+#define TIMER32_0_BASE 0x4000C000
+#define TIMER32_1_BASE 0x4000C020
+
+#define INT_T32_INT1 41
+#define INT_T32_INT2 42
+
+#define TIMER32_0_INTERRUPT INT_T32_INT1
+#define TIMER32_1_INTERRUPT INT_T32_INT2
+
+/* TIMER32_CONTROLx */
+#define TIMER32_CONTROL_ONESHOT     0x01
+#define TIMER32_CONTROL_SIZE        0x02
+#define TIMER32_CONTROL_PRESCALE_MASK 0x0C
+#define TIMER32_CONTROL_IE          0x20
+#define TIMER32_CONTROL_MODE        0x40
+#define TIMER32_CONTROL_ENABLE      0x80
+
+#define TIMER32_PRESCALER_1      0x00
+#define TIMER32_PRESCALER_16     0x04
+#define TIMER32_PRESCALER_256    0x08
+
+#define TIMER32_16BIT            0x00
+#define TIMER32_32BIT            TIMER32_CONTROL_SIZE
+
+#define TIMER32_FREE_RUN_MODE    0x00
+#define TIMER32_PERIODIC_MODE    TIMER32_CONTROL_MODE
+
+void Timer32_initModule( uint32_t, uint32_t, uint32_t, uint32_t );
+void Timer32_setCount( uint32_t, uint32_t );
+uint32_t Timer32_getValue( uint32_t );
+void Timer32_startTimer( uint32_t, bool );
+void Timer32_haltTimer( uint32_t );
+void Timer32_enableInterrupt( uint32_t );
+void Timer32_disableInterrupt( uint32_t );
+void Timer32_clearInterruptFlag( uint32_t );
+uint32_t Timer32_getInterruptStatus( uint32_t );
+void Timer32_registerInterrupt( uint32_t, void (*)( void ) );
+
+#define MAP_Timer32_initModule                    Timer32_initModule
+#define MAP_Timer32_setCount                      Timer32_setCount
+#define MAP_Timer32_getValue                      Timer32_getValue
+#define MAP_Timer32_startTimer                    Timer32_startTimer
+#define MAP_Timer32_haltTimer                     Timer32_haltTimer
+#define MAP_Timer32_enableInterrupt               Timer32_enableInterrupt
+#define MAP_Timer32_disableInterrupt              Timer32_disableInterrupt
+#define MAP_Timer32_clearInterruptFlag            Timer32_clearInterruptFlag
+#define MAP_Timer32_getInterruptStatus            Timer32_getInterruptStatus
+#define MAP_Timer32_registerInterrupt             Timer32_registerInterrupt
+
+/**** Clock system and reset controller ****/
+
+uint32_t CS_getMCLK( void );
+uint32_t CS_getSMCLK( void );
+
+#define MAP_CS_getMCLK                            CS_getMCLK
+#define MAP_CS_getSMCLK                           CS_getSMCLK
+
+/**** Power control ****/
+
+bool PCM_gotoLPM0( void );
+
+#define MAP_PCM_gotoLPM0                          PCM_gotoLPM0
+
+void ResetCtl_initiateHardReset( void );
+
+#define MAP_ResetCtl_initiateHardReset            ResetCtl_initiateHardReset
+
+/**** Cortex-M4 debug: the DWT cycle counter ****/
+
+/**
+ * CYCCNT follows the simulated MCLK cycles, it cannot be written
+ */
+class SimCycleCounter
+{
+public:
+    operator uint32_t( void ) const;
+};
+
+typedef struct
+{
+    uint32_t CTRL;
+    SimCycleCounter CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type * const DWT;
+extern CoreDebug_Type * const CoreDebug;
+
+#define DWT_CTRL_CYCCNTENA_Msk          0x00000001
+#define CoreDebug_DEMCR_TRCENA_Msk      0x01000000
+
+/**** Intrinsics ****/
+
+void __no_operation( void );
+
+#endif /* DWIRE_HOST_DRIVERLIB_H_ */
@@ -0,0 +1,678 @@
+/*
+ * DWire host simulation: regression tests.
+ *
+ * Each test drives DWire against the simulated eUSCI_B and checks the
+ * bytes on the bus, the return codes and the callbacks. The program
+ * prints every check that fails and exits with 1 if there was any.
+ * A DWire master on B1 talks to a register-pointer device; a slave on B0,
+ * bound to that role at compile time, is exercised by the virtual bus
+ * master of the simulator.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <DWire.h>
+#include <I2CScanner.h>
+
+#include "I2CSim.h"
+
+#define CHECK( condition ) check( (condition), #condition, __LINE__ )
+
+DWire master( 1 );
+DWireT<0, BUS_ROLE_SLAVE> slave;
+
+uint8_t memory[256];
+I2CSimMemory sensor( 0x48, memory, sizeof(memory) );
+uint8_t storage[1024];
+I2CSimMemory eeprom( 0x50, storage, sizeof(storage), 2 );
+
+int checks;
+int failures;
+
+uint8_t receiveCalls;
+uint8_t received;
+uint8_t receivedBytes[8];
+uint8_t clockLows;
+uint32_t streamed;
+uint32_t streamErrors;
+
+void check( bool ok, const char * what, int line )
+{
+    checks++;
+    if (!ok)
+    {
+        printf( "test.cpp:%d: FAILED: %s\n", line, what );
+        failures++;
+    }
+}
+
+void handleReceive( uint8_t numBytes )
+{
+    receiveCalls++;
+    received = numBytes;
+    for (uint8_t i = 0; i < numBytes && i < sizeof(receivedBytes); i++)
+    {
+        receivedBytes[i] = slave.read( );
+    }
+}
+
+void handleRequest( void )
+{
+    slave.write( 0x5A );
+}
+
+void handleClockLow( void )
+{
+    clockLows++;
+}
+
+/* The streams move the pointer bytes and then the byte i at i */
+bool streamSource( uint8_t * data )
+{
+    if (streamed == 2 + 400)
+        return false;
+    *data = streamed < 2 ? 0 : (uint8_t) ((streamed - 2) * 7);
+    streamed++;
+    return true;
+}
+
+void streamSink( uint8_t data )
+{
+    if (data != (uint8_t) (streamed * 7))
+    {
+        streamErrors++;
+    }
+    streamed++;
+}
+
+void awaitTransfer( void )
+{
+    while (master.transferStatus( ) == TRANSFER_PENDING)
+    {
+        I2CSim::advance( MAP_CS_getMCLK( ) / 1000 );
+    }
+}
+
+/* A device that is not there NAKs the address */
+void testNak( void )
+{
+    master.beginTransmission( 0x21 );
+    master.write( 0x00 );
+    CHECK( master.endTransmission( ) );
+    CHECK( master.requestFrom( 0x21, 2 ) == 0 );
+
+    uint8_t registers[2];
+    CHECK( master.readRegister( 0x21, 0x00, registers, 2 ) );
+
+    // the bus is still usable afterwards
+    CHECK( !master.writeRegister( 0x48, 0x30, 0x11 ) );
+    CHECK( memory[0x30] == 0x11 );
+}
+
+/* A read of 0 bytes returns 0 without touching the bus or the buffer */
+void testZeroLengthRead( void )
+{
+    uint8_t buffer[4 + 64];
+    memset( buffer, 0xEE, sizeof(buffer) );
+    uint32_t starts = I2CSim::stats( 1 ).starts;
+
+    CHECK( master.requestFrom( 0x48, buffer, 0 ) == 0 );
+    CHECK( master.requestFrom( 0x48, 0 ) == 0 );
+    CHECK( master.requestFromAsync( 0x48, 0 ) );
+    CHECK( I2CSim::stats( 1 ).starts == starts );
+    bool untouched = true;
+    for (uint8_t i = 0; i < sizeof(buffer); i++)
+    {
+        untouched = untouched && buffer[i] == 0xEE;
+    }
+    CHECK( untouched );
+
+    // and the next transfer goes through as usual
+    memory[0x40] = 0x99;
+    master.beginTransmission( 0x48 );
+    master.write( 0x40 );
+    CHECK( master.requestFrom( 0x48, buffer, 1 ) == 1 );
+    CHECK( buffer[0] == 0x99 && buffer[1] == 0xEE );
+}
+
+/* The messages of a combined transfer follow each other with repeated
+ * STARTs, also a write after a read */
+void testCombinedTransfer( void )
+{
+    uint8_t reg = 0x50;
+    uint8_t values[2];
+    uint8_t update[3] = { 0x52, 0x77, 0x78 };
+    memory[0x50] = 0x12;
+    memory[0x51] = 0x34;
+
+    DWireMessage messages[3] = {
+            { 0x48, MESSAGE_WRITE, 1, &reg },
+            { 0x48, MESSAGE_READ, 2, values },
+            { 0x48, MESSAGE_WRITE, 3, update } };
+    CHECK( !master.transfer( messages, 3 ) );
+    CHECK( values[0] == 0x12 && values[1] == 0x34 );
+    CHECK( memory[0x52] == 0x77 && memory[0x53] == 0x78 );
+
+    // the same with the write first and the read last
+    DWireMessage swapped[3] = {
+            { 0x48, MESSAGE_WRITE, 3, update },
+            { 0x48, MESSAGE_WRITE, 1, &reg },
+            { 0x48, MESSAGE_READ, 2, values } };
+    update[1] = 0x79;
+    values[0] = values[1] = 0;
+    CHECK( !master.transfer( swapped, 3 ) );
+    CHECK( memory[0x52] == 0x79 );
+    CHECK( values[0] == 0x12 && values[1] == 0x34 );
+}
+
+/* A single byte read on an idle bus takes a single byte, ended by the byte
+ * counter. After a write, the counter cannot be used: the read takes two
+ * bytes on the bus and the second one is dropped */
+void testSingleByteRead( void )
+{
+    uint8_t value[2] = { 0, 0xEE };
+    memory[0x60] = 0xA5;
+    memory[0x61] = 0x5A;
+    memory[0x62] = 0x3C;
+
+    uint32_t bytes = I2CSim::stats( 1 ).bytesRx;
+    CHECK( !master.readRegister( 0x48, 0x60, value, 1 ) );
+    CHECK( value[0] == 0xA5 && value[1] == 0xEE );
+    CHECK( I2CSim::stats( 1 ).bytesRx == bytes + 2 );
+
+    // the dropped byte has moved the register pointer of the device on
+    bytes = I2CSim::stats( 1 ).bytesRx;
+    CHECK( master.requestFrom( 0x48, 1 ) == 1 );
+    CHECK( master.read( ) == 0x3C );
+    CHECK( I2CSim::stats( 1 ).bytesRx == bytes + 1 );
+
+    // the same at 1 MHz, also through a caller's buffer
+    master.setFastModePlus( );
+    master.begin( );
+    bytes = I2CSim::stats( 1 ).bytesRx;
+    CHECK( !master.readRegister( 0x48, 0x61, value, 1 ) );
+    CHECK( value[0] == 0x5A && value[1] == 0xEE );
+    CHECK( I2CSim::stats( 1 ).bytesRx == bytes + 2 );
+
+    bytes = I2CSim::stats( 1 ).bytesRx;
+    master.beginTransmission( 0x48 );
+    master.write( 0x60 );
+    CHECK( master.requestFrom( 0x48, value, 1 ) == 1 );
+    CHECK( value[0] == 0xA5 && value[1] == 0xEE );
+    CHECK( I2CSim::stats( 1 ).bytesRx == bytes + 2 );
+    master.setFastMode( );
+    master.begin( );
+}
+
+/* enableDMA sets up the control table of DWire if there is none, and the
+ * DMA moves the data of the transfers */
+void testDma( void )
+{
+    uint8_t values[8];
+    const uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    CHECK( !MAP_DMA_getControlBase( ) );
+    master.enableDMA( );
+    master.begin( );
+    CHECK( MAP_DMA_getControlBase( ) != 0 );
+
+    CHECK( !master.writeRegister( 0x48, 0x70, data, sizeof(data) ) );
+    CHECK( !master.readRegister( 0x48, 0x70, values, sizeof(values) ) );
+    CHECK( memcmp( values, data, sizeof(data) ) == 0 );
+
+    master.disableDMA( );
+    master.begin( );
+}
+
+/* Time keeps counting while the bus is idle, past the timeout deadlines
+ * that have passed in between */
+void testTraceClock( void )
+{
+    DWireTraceEvent events[TRACE_SIZE];
+    while (master.readTrace( events, TRACE_SIZE ))
+        ;
+
+    CHECK( !master.writeRegister( 0x48, 0x31, 0x22 ) );
+    I2CSim::advance( (uint64_t) MAP_CS_getMCLK( ) / 10 );
+    CHECK( !master.writeRegister( 0x48, 0x31, 0x23 ) );
+
+    uint8_t count = master.readTrace( events, TRACE_SIZE );
+    uint32_t starts[2];
+    uint8_t found = 0;
+    for (uint8_t i = 0; i < count && found < 2; i++)
+    {
+        if (events[i].type == TRACE_START)
+        {
+            starts[found++] = events[i].time;
+        }
+    }
+    CHECK( found == 2 );
+    // 100 ms, give or take the first write and the rounding of the ticks
+    uint32_t apart = starts[1] - starts[0];
+    CHECK( apart >= 100000 && apart < 100000 + 500 );
+}
+
+/* A blocking transfer on a stuck bus times out also without low power,
+ * with the deadline checked by the polling wait, and the bus is cleared */
+void testBlockingTimeout( void )
+{
+    master.setTimeout( 1000 );
+
+    I2CSim::holdSda( 1, 5 );
+    uint64_t start = I2CSim::now( );
+    master.beginTransmission( 0x48 );
+    master.write( 0x33 );
+    master.write( 0x55 );
+    CHECK( master.endTransmission( ) );
+    CHECK( master.timedOut( ) );
+    // the poll for the START (TIMEOUTLIMIT rounds) runs on after the
+    // timeout, then the bus is cleared
+    CHECK( I2CSim::now( ) - start < (uint64_t) MAP_CS_getMCLK( ) / 50 );
+
+    uint8_t registers[1];
+    I2CSim::holdSda( 1, 3 );
+    CHECK( master.readRegister( 0x48, 0x33, registers, 1 ) );
+    CHECK( master.timedOut( ) );
+
+    // with the interrupt of the module held off, the first byte received
+    // is never read and the bus stalls after the START: only the polling
+    // wait can see the deadline pass
+    MAP_Interrupt_disableInterrupt( INT_EUSCIB1 );
+    CHECK( master.requestFrom( 0x48, 4 ) == 0 );
+    CHECK( master.timedOut( ) );
+    MAP_Interrupt_enableInterrupt( INT_EUSCIB1 );
+
+    CHECK( !master.writeRegister( 0x48, 0x33, 0x66 ) );
+    CHECK( !master.timedOut( ) && memory[0x33] == 0x66 );
+
+    master.setTimeout( DEFAULT_TIMEOUT );
+}
+
+/* The time in the blocking calls adds up beyond the 2^32 ticks of the
+ * Timer32 (about 24 minutes at 48 MHz) */
+void testWaitTime( void )
+{
+    DWireStatistics counters;
+    master.clearStatistics( );
+    master.setTimeout( 700000000 );
+    master.enableLowPower( );
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        I2CSim::holdSda( 1, 5 );
+        master.beginTransmission( 0x48 );
+        master.write( 0x33 );
+        CHECK( master.endTransmission( ) && master.timedOut( ) );
+    }
+    master.statistics( &counters );
+    CHECK( counters.timeouts == 3 );
+    CHECK( counters.waitTime >= 2100000000ULL && counters.waitTime < 2100000000ULL + 10000 );
+
+    master.disableLowPower( );
+    master.setTimeout( DEFAULT_TIMEOUT );
+}
+
+/* An asynchronous transfer on a stuck bus times out in the timer interrupt,
+ * and the bus is cleared from the main thread: by process( ), or by the
+ * wait for the queue, which then goes on with the next transaction */
+void testAsyncTimeout( void )
+{
+    DWireTraceEvent events[TRACE_SIZE];
+    while (master.readTrace( events, TRACE_SIZE ))
+        ;
+    master.setTimeout( 1000 );
+
+    I2CSim::holdSda( 1, 5 );
+    master.beginTransmission( 0x48 );
+    master.write( 0x10 );
+    CHECK( !master.endTransmissionAsync( ) );
+    I2CSim::advance( (uint64_t) MAP_CS_getMCLK( ) / 500 );
+    CHECK( master.transferStatus( ) == TRANSFER_PENDING );
+    CHECK( master.process( ) );
+    CHECK( master.transferStatus( ) == TRANSFER_FAILED && master.timedOut( ) );
+    CHECK( !master.process( ) );
+
+    // the timer interrupt leaves the event to process( ), with the time
+    // it found the timeout at
+    uint8_t count = master.readTrace( events, TRACE_SIZE );
+    uint8_t timeout = count;
+    uint8_t reset = count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (events[i].type == TRACE_TIMEOUT)
+            timeout = i;
+        else if (events[i].type == TRACE_BUS_RESET)
+            reset = i;
+    }
+    CHECK( count && events[0].type == TRACE_START );
+    CHECK( timeout < reset && reset < count );
+    uint32_t found = events[timeout].time - events[0].time;
+    // the deadline counts from before the START
+    CHECK( found >= 990 && found < 1100 );
+    CHECK( events[reset].time - events[0].time >= 2000 );
+
+    const uint8_t data[2] = { 0x32, 0x44 };
+    DWireTransaction transactions[2];
+    memset( transactions, 0, sizeof(transactions) );
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        transactions[i].address = 0x48;
+        transactions[i].writeData = data;
+        transactions[i].writeLength = sizeof(data);
+    }
+    I2CSim::holdSda( 1, 5 );
+    master.enableLowPower( );
+    CHECK( !master.queue( &transactions[0] ) );
+    CHECK( !master.queue( &transactions[1] ) );
+    DWire::waitGroup( GROUP_B1 );
+    master.disableLowPower( );
+    CHECK( transactions[0].status == TRANSFER_FAILED );
+    CHECK( transactions[1].status == TRANSFER_SUCCESS && memory[0x32] == 0x44 );
+
+    master.setTimeout( DEFAULT_TIMEOUT );
+}
+
+/* Streams go past the 255 bytes of a buffered transfer both ways, and a
+ * read stream ends on its length, also a single byte one */
+void testStreams( void )
+{
+    streamed = 0;
+    CHECK( !master.writeStreamAsync( 0x50, streamSource ) );
+    awaitTransfer( );
+    CHECK( master.transferStatus( ) == TRANSFER_SUCCESS );
+    CHECK( master.streamedBytes( ) == 2 + 400 && eeprom.pointer == 400 );
+    CHECK( storage[0] == 0 && storage[399] == (uint8_t) (399 * 7) && storage[400] == 0 );
+
+    master.beginTransmission( 0x50 );
+    master.write( 0 );
+    master.write( 0 );
+    CHECK( !master.endTransmission( ) );
+    streamed = 0;
+    streamErrors = 0;
+    CHECK( !master.readStreamAsync( 0x50, 400, streamSink ) );
+    awaitTransfer( );
+    CHECK( master.transferStatus( ) == TRANSFER_SUCCESS );
+    CHECK( master.streamedBytes( ) == 400 && streamed == 400 && !streamErrors );
+    CHECK( eeprom.pointer == 400 );
+
+    // on an idle bus the byte counter ends it after the byte
+    master.beginTransmission( 0x50 );
+    master.write( 0 );
+    master.write( 5 );
+    CHECK( !master.endTransmission( ) );
+    streamed = 5;
+    uint32_t before = I2CSim::stats( 1 ).bytesRx;
+    CHECK( !master.readStreamAsync( 0x50, 1, streamSink ) );
+    awaitTransfer( );
+    CHECK( master.transferStatus( ) == TRANSFER_SUCCESS );
+    CHECK( master.streamedBytes( ) == 1 && streamed == 6 && !streamErrors );
+    CHECK( I2CSim::stats( 1 ).bytesRx == before + 1 && eeprom.pointer == 6 );
+}
+
+bool isPresent( const I2CScanState & state, uint8_t address )
+{
+    return state.present[address >> 5] & (1UL << (address & 31));
+}
+
+/* rescan probes the addresses not known yet, then the ones it refreshes,
+ * and counts the devices that came and went */
+void testRescan( void )
+{
+    uint8_t scratch[16];
+    I2CSimMemory extra( 0x30, scratch, sizeof(scratch) );
+    I2CScanState state;
+    memset( &state, 0, sizeof(state) );
+
+    CHECK( I2CScanner::rescan( master, state, 0 ) == 2 );
+    CHECK( isPresent( state, 0x48 ) && isPresent( state, 0x50 ) && !isPresent( state, 0x30 ) );
+    CHECK( state.known[0] == 0xFFFFFFFE && state.known[3] == 0x3FFFFFFF );
+    CHECK( I2CScanner::rescan( master, state, 0 ) == 0 );
+
+    // a device comes and another one goes: seen once they are refreshed
+    I2CSim::attach( 1, &extra );
+    I2CSim::detach( 1, &eeprom );
+    CHECK( I2CScanner::rescan( master, state, 0 ) == 0 );
+    CHECK( I2CScanner::rescan( master, state, 125 ) == 2 );
+    CHECK( isPresent( state, 0x30 ) && !isPresent( state, 0x50 ) && isPresent( state, 0x48 ) );
+    CHECK( state.next == 126 );
+
+    // an address whose known bit is cleared is probed again by itself
+    I2CSim::attach( 1, &eeprom );
+    I2CSim::detach( 1, &extra );
+    state.known[0x50 >> 5] &= ~(1UL << (0x50 & 31));
+    CHECK( I2CScanner::rescan( master, state, 0 ) == 1 );
+    CHECK( isPresent( state, 0x50 ) && isPresent( state, 0x30 ) );
+    CHECK( state.known[0x50 >> 5] & (1UL << (0x50 & 31)) );
+
+    // the refresh goes on where it stopped, from the first address again
+    CHECK( I2CScanner::rescan( master, state, 0x30 ) == 1 );
+    CHECK( !isPresent( state, 0x30 ) && state.next == 0x31 );
+}
+
+/* Another master wins the bus during the address: the transfer fails
+ * right away, is counted, and the next one goes through */
+void testArbitration( void )
+{
+    DWireStatistics counters;
+    uint8_t buffer[2];
+    master.clearStatistics( );
+
+    I2CSim::loseArbitration( 1 );
+    master.beginTransmission( 0x48 );
+    master.write( 0x20 );
+    master.write( 0x5A );
+    CHECK( master.endTransmission( ) && !master.timedOut( ) );
+    CHECK( master.isMaster( ) );
+    master.beginTransmission( 0x48 );
+    master.write( 0x20 );
+    master.write( 0x5B );
+    CHECK( !master.endTransmission( ) && memory[0x20] == 0x5B );
+
+    I2CSim::loseArbitration( 1 );
+    CHECK( master.requestFrom( 0x48, buffer, 2 ) == 0 );
+    master.beginTransmission( 0x48 );
+    master.write( 0x20 );
+    CHECK( !master.endTransmission( false ) );
+    CHECK( master.requestFrom( 0x48, buffer, 2 ) == 2 && buffer[0] == 0x5B );
+
+    master.enableDMA( );
+    I2CSim::loseArbitration( 1 );
+    master.beginTransmission( 0x48 );
+    master.write( 0x21 );
+    master.write( 0x66 );
+    CHECK( master.endTransmission( ) );
+    master.disableDMA( );
+
+    const uint8_t data[2] = { 0x22, 0x77 };
+    DWireTransaction transactions[2];
+    memset( transactions, 0, sizeof(transactions) );
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        transactions[i].address = 0x48;
+        transactions[i].writeData = data;
+        transactions[i].writeLength = sizeof(data);
+    }
+    I2CSim::loseArbitration( 1 );
+    CHECK( !master.queue( &transactions[0] ) );
+    CHECK( !master.queue( &transactions[1] ) );
+    DWire::waitGroup( GROUP_B1 );
+    CHECK( transactions[0].status == TRANSFER_FAILED );
+    CHECK( transactions[1].status == TRANSFER_SUCCESS && memory[0x22] == 0x77 );
+
+    master.statistics( &counters );
+    CHECK( counters.arbitrationLosses == 4 && counters.busResets == 0
+            && counters.timeouts == 0 );
+}
+
+/* Every frame written to the slave gives a single onReceive with its own
+ * bytes, also with reads of the master in between */
+void testSlaveReceive( void )
+{
+    const uint8_t first[3] = { 0x01, 0x02, 0x03 };
+    const uint8_t second[2] = { 0x04, 0x05 };
+    uint8_t response;
+
+    receiveCalls = 0;
+    CHECK( I2CSim::masterWrite( 0, 0x42, first, sizeof(first) ) == 3 );
+    CHECK( receiveCalls == 1 && received == 3 );
+    CHECK( memcmp( receivedBytes, first, 3 ) == 0 );
+
+    CHECK( I2CSim::masterRead( 0, 0x42, &response, 1 ) == 1 );
+    CHECK( response == 0x5A );
+    CHECK( receiveCalls == 1 );
+
+    CHECK( I2CSim::masterWrite( 0, 0x42, second, sizeof(second) ) == 2 );
+    CHECK( receiveCalls == 2 && received == 2 );
+    CHECK( memcmp( receivedBytes, second, 2 ) == 0 );
+}
+
+/* A DWireT bound to the slave role does not begin as a master, and goes
+ * on as a slave */
+void testBoundRole( void )
+{
+    const uint8_t data[1] = { 0x08 };
+
+    slave.begin( );
+    CHECK( !slave.isMaster( ) );
+    receiveCalls = 0;
+    CHECK( I2CSim::masterWrite( 0, 0x42, data, sizeof(data) ) == 1 );
+    CHECK( receiveCalls == 1 && receivedBytes[0] == 0x08 );
+}
+
+/* A frame ring that is not a power of two bytes is rounded down: of 24
+ * bytes, the first 16 take the frames */
+void testFrameRingSize( void )
+{
+    const uint8_t data[5] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+    uint8_t ring[24];
+    uint8_t frame[8];
+    memset( ring, 0xEE, sizeof(ring) );
+    slave.receiveFrames( ring, sizeof(ring) );
+
+    // a frame takes its length and its bytes, the third does not fit
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        CHECK( I2CSim::masterWrite( 0, 0x42, data, sizeof(data) ) == 5 );
+    }
+    CHECK( slave.framesLost( ) == 1 );
+    for (uint8_t i = 16; i < sizeof(ring); i++)
+    {
+        CHECK( ring[i] == 0xEE );
+    }
+    CHECK( slave.readFrame( frame, sizeof(frame) ) == 5 && frame[4] == 0x05 );
+    CHECK( slave.readFrame( frame, sizeof(frame) ) == 5 && frame[0] == 0x01 );
+    CHECK( slave.readFrame( frame, sizeof(frame) ) == 0 );
+    slave.receiveFrames( 0, 0 );
+}
+
+/* The critical sections leave interrupts as they found them: held off by
+ * the caller, they stay held off */
+void testCriticalSections( void )
+{
+    uint8_t ring[16];
+    MAP_Interrupt_disableInterrupt( INT_EUSCIB0 );
+    slave.receiveFrames( ring, sizeof(ring) );
+    slave.receiveFrames( 0, 0 );
+    CHECK( !MAP_Interrupt_isEnabled( INT_EUSCIB0 ) );
+    MAP_Interrupt_enableInterrupt( INT_EUSCIB0 );
+    slave.receiveFrames( ring, sizeof(ring) );
+    slave.receiveFrames( 0, 0 );
+    CHECK( MAP_Interrupt_isEnabled( INT_EUSCIB0 ) );
+
+    const uint8_t data[2] = { 0x34, 0x45 };
+    DWireTransaction transaction;
+    memset( &transaction, 0, sizeof(transaction) );
+    transaction.address = 0x48;
+    transaction.writeData = data;
+    transaction.writeLength = sizeof(data);
+    MAP_Interrupt_disableMaster( );
+    CHECK( !master.queue( &transaction ) );
+    CHECK( MAP_Interrupt_disableMaster( ) );
+    MAP_Interrupt_enableMaster( );
+    DWire::waitGroup( GROUP_B1 );
+    CHECK( transaction.status == TRANSFER_SUCCESS && memory[0x34] == 0x45 );
+}
+
+/* A master that holds SCL low for too long gets the slave to let go of
+ * the bus; it goes on right away, and process( ) calls onClockLow */
+void testClockLow( void )
+{
+    const uint8_t data[2] = { 0x06, 0x07 };
+    uint8_t response[3];
+
+    // there is a single byte to send, the clock is stretched for the next
+    CHECK( I2CSim::masterRead( 0, 0x42, response, 3 ) == -2 );
+    CHECK( clockLows == 0 );
+
+    receiveCalls = 0;
+    CHECK( I2CSim::masterWrite( 0, 0x42, data, sizeof(data) ) == 2 );
+    CHECK( receiveCalls == 1 && received == 2 );
+    CHECK( memcmp( receivedBytes, data, 2 ) == 0 );
+
+    CHECK( slave.process( ) );
+    CHECK( clockLows == 1 );
+    CHECK( !slave.process( ) );
+}
+
+/* A slave whose main loop never calls process( ) recovers from clock low
+ * timeouts all the same, one after the other */
+void testClockLowWithoutProcess( void )
+{
+    const uint8_t data[3] = { 0x09, 0x0A, 0x0B };
+    uint8_t response[3];
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        CHECK( I2CSim::masterRead( 0, 0x42, response, 3 ) == -2 );
+
+        receiveCalls = 0;
+        CHECK( I2CSim::masterWrite( 0, 0x42, data, sizeof(data) ) == 3 );
+        CHECK( receiveCalls == 1 && received == 3 );
+        CHECK( memcmp( receivedBytes, data, 3 ) == 0 );
+
+        CHECK( I2CSim::masterRead( 0, 0x42, response, 1 ) == 1 );
+        CHECK( response[0] == 0x5A );
+    }
+    CHECK( clockLows == 1 );
+}
+
+int main( void )
+{
+    I2CSim::attach( 1, &sensor );
+    I2CSim::attach( 1, &eeprom );
+    master.setFastMode( );
+    master.begin( );
+
+    slave.begin( 0x42 );
+    slave.onReceive( handleReceive );
+    slave.onRequest( handleRequest );
+    slave.onClockLow( handleClockLow );
+
+    testNak( );
+    testZeroLengthRead( );
+    testCombinedTransfer( );
+    testSingleByteRead( );
+    testDma( );
+    testTraceClock( );
+    testBlockingTimeout( );
+    testAsyncTimeout( );
+    testArbitration( );
+    testStreams( );
+    testRescan( );
+    testWaitTime( );
+    testSlaveReceive( );
+    testBoundRole( );
+    testFrameRingSize( );
+    testCriticalSections( );
+    testClockLow( );
+    testClockLowWithoutProcess( );
+
+    printf( "%d checks, %d failed\n", checks, failures );
+    return failures ? 1 : 0;
+}